@@ -30,49 +30,42 @@
 #include <cstddef>
 #include <utility>
 
+#include <Matrix.hpp>
+#include <Options.hpp>
+#include <Reporter.hpp>
+#include <ReportSinks.hpp>
 #include <Runner.hpp>
-#include <Types.hpp>
-#include <Structs.hpp>
-#include <Tests.hpp>
 
-using sizes = std::index_sequence<
-	1024,
-	32 * 1024,
-	1 * 1024 * 1024,
-	16 * 1024 * 1024,
-	0>;
-
-using types = std::tuple<
-	uint64_t,
-	char_ptr,
-	nullptr_t
->;
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!options.parse(argc, argv))
+		return 1;
 
-template <typename TYPE>
-using structs = std::tuple<
-	StdSetStruct<TYPE>,
-	StdUnorderedSetStruct<TYPE>,
-	nullptr_t
->;
+	/* One arena keeps malloc statistics whole but slows threads down. */
+	if (!options.mem)
+		MemMeasurer::disable();
+	else if (mallopt(M_ARENA_MAX, 1) != 1)
+		std::cout << "Failed to set mallopt. Memory measurement could be inaccurate." << std::endl;
 
-template <size_t SIZE, typename TYPE, class STRUCT>
-using tests = std::tuple<
-	Insert<SIZE, TYPE, STRUCT>,
-	Delete<SIZE, TYPE, STRUCT>,
-	SearchHit<SIZE, TYPE, STRUCT>,
-	SearchMiss<SIZE, TYPE, STRUCT>,
-	SearchMixed<SIZE, TYPE, STRUCT>,
-	RandWorkload<SIZE, TYPE, STRUCT>,
-	nullptr_t
->;
+	select_data_pages(options.pages);
 
-int main()
-{
-	int rc = mallopt(M_ARENA_MAX, 1);
-	if (rc != 1)
-		std::cout << "Failed to set mallopt. Memory measurement could be inaccurate." << std::endl;
+	bool multithreaded = std::any_of(options.threads.begin(),
+					 options.threads.end(),
+					 [](size_t n) { return n > 1; });
+	Reporter reporter((options.perf ? Reporter::PERF : 0) |
+			  (options.latency ? Reporter::LATENCY : 0) |
+			  (options.cold ? Reporter::COLD : 0) |
+			  (multithreaded ? Reporter::THREADS : 0) |
+			  (options.stats ? Reporter::STATS : 0) |
+			  (options.quality ? Reporter::QUALITY : 0));
+	if (!options.list && !attach_sinks(reporter, options))
+		return 1;
 
-	size_t total_run = AllTests<sizes, types, structs, tests>::run_all();
+	size_t total_run = run_cells(matrix_cells(types{}), options, reporter);
+	reporter.done();
 
-	std::cout << "Total tests was run: " << total_run << std::endl;
+	if (!options.list)
+		std::cout << "Total tests was run: " << total_run << std::endl;
+	return reporter.regressions() == 0 ? 0 : 2;
 }
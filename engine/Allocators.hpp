@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+/*
+ * Pools of objects of fixed sizes. Objects are cut from slabs allocated
+ * with malloc, freed objects go to a free list of their pool and are
+ * taken from there first. Memory goes back to malloc with the heap only.
+ * A container needs a pool or two: for nodes and, maybe, for buckets.
+ */
+class SlabHeap {
+public:
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+	class Pool {
+	public:
+		Pool(SlabHeap *heap, size_t size) : m_Heap(heap), m_Size(size) {}
+
+		void *alloc()
+		{
+			if (m_FreeList != nullptr) {
+				void *res = m_FreeList;
+				m_FreeList = *(void **)res;
+				return res;
+			}
+			if ((size_t)(m_End - m_Pos) < m_Size) {
+				m_Pos = m_Heap->slab();
+				m_End = m_Pos + SLAB_SIZE - SLAB_HEADER;
+			}
+			void *res = m_Pos;
+			m_Pos += m_Size;
+			return res;
+		}
+		void free(void *p)
+		{
+			*(void **)p = m_FreeList;
+			m_FreeList = p;
+		}
+		size_t size() const
+		{
+			return m_Size;
+		}
+		void reset()
+		{
+			m_FreeList = nullptr;
+			m_Pos = m_End = nullptr;
+		}
+
+	private:
+		SlabHeap *m_Heap;
+		size_t m_Size;
+		void *m_FreeList = nullptr;
+		char *m_Pos = nullptr;
+		char *m_End = nullptr;
+	};
+
+	SlabHeap() = default;
+	SlabHeap(const SlabHeap&) = delete;
+	SlabHeap& operator=(const SlabHeap&) = delete;
+	~SlabHeap()
+	{
+		release();
+	}
+
+	/* Free all the slabs, objects of the pools must be dead. */
+	void release()
+	{
+		while (m_Slabs != nullptr) {
+			Slab *next = m_Slabs->next;
+			::free(m_Slabs);
+			m_Slabs = next;
+		}
+		for (const auto& p : m_Pools)
+			p->reset();
+	}
+
+	/* Pool of objects of @size bytes, made on the first request. */
+	Pool *pool(size_t size, size_t align)
+	{
+		align = std::max(align, ALIGN);
+		size = (size + align - 1) / align * align;
+		assert(size <= SLAB_SIZE - SLAB_HEADER);
+		for (const auto& p : m_Pools) {
+			if (p->size() == size)
+				return p.get();
+		}
+		m_Pools.push_back(std::make_unique<Pool>(this, size));
+		return m_Pools.back().get();
+	}
+
+private:
+	struct Slab {
+		Slab *next;
+	};
+	/* Free objects keep a pointer, slabs are aligned as malloc does. */
+	static constexpr size_t ALIGN = sizeof(void *);
+	static constexpr size_t SLAB_HEADER = alignof(std::max_align_t);
+
+	char *slab()
+	{
+		Slab *s = (Slab *)malloc(SLAB_SIZE);
+		if (s == nullptr)
+			throw std::bad_alloc();
+		s->next = m_Slabs;
+		m_Slabs = s;
+		return (char *)s + SLAB_HEADER;
+	}
+
+	Slab *m_Slabs = nullptr;
+	std::vector<std::unique_ptr<Pool>> m_Pools;
+};
+
+/* Allocator of single objects from SlabHeap, arrays come from malloc. */
+template <typename T>
+class SlabAllocator {
+public:
+	using value_type = T;
+	static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned");
+
+	explicit SlabAllocator(SlabHeap *heap)
+		: m_Heap(heap), m_Pool(heap->pool(sizeof(T), alignof(T))) {}
+	template <typename U>
+	SlabAllocator(const SlabAllocator<U>& other)
+		: SlabAllocator(other.heap()) {}
+
+	T *allocate(size_t n)
+	{
+		if (n == 1)
+			return (T *)m_Pool->alloc();
+		void *res = malloc(n * sizeof(T));
+		if (res == nullptr)
+			throw std::bad_alloc();
+		return (T *)res;
+	}
+	void deallocate(T *p, size_t n)
+	{
+		if (n == 1)
+			m_Pool->free(p);
+		else
+			free(p);
+	}
+
+	SlabHeap *heap() const
+	{
+		return m_Heap;
+	}
+	template <typename U>
+	bool operator==(const SlabAllocator<U>& other) const
+	{
+		return m_Heap == other.heap();
+	}
+	template <typename U>
+	bool operator!=(const SlabAllocator<U>& other) const
+	{
+		return m_Heap != other.heap();
+	}
+
+private:
+	SlabHeap *m_Heap;
+	SlabHeap::Pool *m_Pool;
+};
+
+/*
+ * Bump allocation from chunks taken with malloc, each twice as big as the
+ * previous one up to MAX_CHUNK. Freed memory is not reused, all of it goes
+ * back to malloc with the arena.
+ */
+class MonotonicArena {
+public:
+	static constexpr size_t MIN_CHUNK = 4 * 1024;
+	static constexpr size_t MAX_CHUNK = 1024 * 1024;
+
+	MonotonicArena() = default;
+	MonotonicArena(const MonotonicArena&) = delete;
+	MonotonicArena& operator=(const MonotonicArena&) = delete;
+	~MonotonicArena()
+	{
+		release();
+	}
+
+	void release()
+	{
+		while (m_Chunks != nullptr) {
+			Chunk *next = m_Chunks->next;
+			free(m_Chunks);
+			m_Chunks = next;
+		}
+		m_Pos = m_End = nullptr;
+		m_NextSize = MIN_CHUNK;
+	}
+
+	void *alloc(size_t size, size_t align)
+	{
+		uintptr_t pos = ((uintptr_t)m_Pos + align - 1) & ~(uintptr_t)(align - 1);
+		if (m_Pos == nullptr || pos + size > (uintptr_t)m_End) {
+			chunk(size + align);
+			pos = ((uintptr_t)m_Pos + align - 1) & ~(uintptr_t)(align - 1);
+		}
+		m_Pos = (char *)(pos + size);
+		return (void *)pos;
+	}
+
+private:
+	struct Chunk {
+		Chunk *next;
+	};
+	static constexpr size_t CHUNK_HEADER = alignof(std::max_align_t);
+
+	/* A request larger than a chunk gets a chunk of its own size. */
+	void chunk(size_t size)
+	{
+		size_t chunk_size = std::max(m_NextSize, size + CHUNK_HEADER);
+		Chunk *c = (Chunk *)malloc(chunk_size);
+		if (c == nullptr)
+			throw std::bad_alloc();
+		c->next = m_Chunks;
+		m_Chunks = c;
+		m_Pos = (char *)c + CHUNK_HEADER;
+		m_End = (char *)c + chunk_size;
+		m_NextSize = std::min(m_NextSize * 2, MAX_CHUNK);
+	}
+
+	Chunk *m_Chunks = nullptr;
+	char *m_Pos = nullptr;
+	char *m_End = nullptr;
+	size_t m_NextSize = MIN_CHUNK;
+};
+
+/* Allocator from MonotonicArena, deallocation does nothing. */
+template <typename T>
+class ArenaAllocator {
+public:
+	using value_type = T;
+
+	explicit ArenaAllocator(MonotonicArena *arena) : m_Arena(arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_Arena(other.arena()) {}
+
+	T *allocate(size_t n)
+	{
+		return (T *)m_Arena->alloc(n * sizeof(T), alignof(T));
+	}
+	void deallocate(T *, size_t)
+	{
+	}
+
+	MonotonicArena *arena() const
+	{
+		return m_Arena;
+	}
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const
+	{
+		return m_Arena == other.arena();
+	}
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const
+	{
+		return m_Arena != other.arena();
+	}
+
+private:
+	MonotonicArena *m_Arena;
+};
+
+/*
+ * Upstream of pmr resources is the default one, operator new: pools ask it
+ * for chunks aligned more than malloc aligns, those come from the aligned
+ * allocation functions, measured as malloc is.
+ */
+struct PmrPoolResource : std::pmr::unsynchronized_pool_resource {};
+
+struct PmrMonotonicResource : std::pmr::monotonic_buffer_resource {};
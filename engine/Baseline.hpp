@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+
+/*
+ * Results of a previous run loaded from a JSON lines file written with
+ * --json. Only flat objects with string, number and null values are
+ * understood, that is what the JSON sink writes.
+ */
+class Baseline {
+public:
+	struct Entry {
+		double Mrps;
+		double bytes_per_record;
+	};
+
+	bool load(const char *path)
+	{
+		std::ifstream in(path);
+		if (!in)
+			return false;
+		std::string line;
+		while (std::getline(in, line)) {
+			std::map<std::string, std::string> fields;
+			if (!parse(line, fields))
+				return false;
+			if (fields["record"] != "row")
+				continue;
+			std::string key = makeKey(
+				strtoul(fields["size"].c_str(), nullptr, 10),
+				fields["type"].c_str(), fields["struct"].c_str(),
+				fields["test"].c_str(),
+				fields["dist"].empty() ? "-" : fields["dist"].c_str(),
+				fields["hash"].empty() ? "-" : fields["hash"].c_str(),
+				strtoul(fields["threads"].c_str(), nullptr, 10));
+			Entry entry{strtod(fields["mrps"].c_str(), nullptr),
+				    strtod(fields["bytes_per_elem"].c_str(), nullptr)};
+			/* Of repeated runs the best one is kept. */
+			auto res = m_Entries.emplace(key, entry);
+			if (!res.second && res.first->second.Mrps < entry.Mrps)
+				res.first->second = entry;
+		}
+		return true;
+	}
+
+	const Entry *find(size_t size, const char *type, const char *struct_name,
+			  const char *test_name, const char *dist,
+			  const char *hash, size_t threads) const
+	{
+		auto it = m_Entries.find(makeKey(size, type, struct_name,
+						 test_name, dist, hash, threads));
+		return it == m_Entries.end() ? nullptr : &it->second;
+	}
+
+private:
+	static std::string makeKey(size_t size, const char *type,
+				   const char *struct_name,
+				   const char *test_name, const char *dist,
+				   const char *hash, size_t threads)
+	{
+		return std::to_string(size) + '\n' + type + '\n' + struct_name +
+		       '\n' + test_name + '\n' + dist + '\n' + hash + '\n' +
+		       std::to_string(threads);
+	}
+
+	static void skipSpace(const std::string& s, size_t& pos)
+	{
+		while (pos < s.size() && isspace((unsigned char)s[pos]))
+			pos++;
+	}
+
+	static bool parseString(const std::string& s, size_t& pos,
+				std::string& out)
+	{
+		if (pos >= s.size() || s[pos] != '"')
+			return false;
+		out.clear();
+		for (pos++; pos < s.size() && s[pos] != '"'; pos++) {
+			if (s[pos] != '\\') {
+				out += s[pos];
+				continue;
+			}
+			if (++pos == s.size())
+				return false;
+			switch (s[pos]) {
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			case 'r': out += '\r'; break;
+			case 'u':
+				if (pos + 4 >= s.size())
+					return false;
+				out += char(strtoul(s.substr(pos + 1, 4).c_str(),
+						    nullptr, 16));
+				pos += 4;
+				break;
+			default: out += s[pos]; break;
+			}
+		}
+		if (pos == s.size())
+			return false;
+		pos++;
+		return true;
+	}
+
+	static bool parse(const std::string& s,
+			  std::map<std::string, std::string>& fields)
+	{
+		size_t pos = 0;
+		skipSpace(s, pos);
+		if (pos == s.size())
+			return true;
+		if (s[pos++] != '{')
+			return false;
+		while (true) {
+			skipSpace(s, pos);
+			if (pos < s.size() && s[pos] == '}')
+				return true;
+			std::string key, value;
+			if (!parseString(s, pos, key))
+				return false;
+			skipSpace(s, pos);
+			if (pos == s.size() || s[pos++] != ':')
+				return false;
+			skipSpace(s, pos);
+			if (pos < s.size() && s[pos] == '"') {
+				if (!parseString(s, pos, value))
+					return false;
+			} else {
+				size_t end = s.find_first_of(",}", pos);
+				if (end == std::string::npos)
+					return false;
+				value = s.substr(pos, end - pos);
+				while (!value.empty() && isspace((unsigned char)value.back()))
+					value.pop_back();
+				if (value == "null")
+					value.clear();
+				pos = end;
+			}
+			fields[key] = value;
+			skipSpace(s, pos);
+			if (pos < s.size() && s[pos] == ',')
+				pos++;
+		}
+	}
+
+	std::map<std::string, Entry> m_Entries;
+};
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <DataArena.hpp>
+
+/*
+ * Size of the biggest (last level) CPU cache in bytes, 0 if sysfs does not
+ * tell it.
+ */
+inline size_t last_level_cache_size()
+{
+	size_t best_level = 0, res = 0;
+	for (size_t i = 0; ; i++) {
+		std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" +
+				  std::to_string(i);
+		std::ifstream level_in(dir + "/level");
+		std::ifstream size_in(dir + "/size");
+		size_t level;
+		std::string size;
+		if (!(level_in >> level) || !(size_in >> size))
+			break;
+		size_t bytes = strtoul(size.c_str(), nullptr, 10);
+		if (size.back() == 'K')
+			bytes <<= 10;
+		else if (size.back() == 'M')
+			bytes <<= 20;
+		if (level > best_level || (level == best_level && bytes > res)) {
+			best_level = level;
+			res = bytes;
+		}
+	}
+	return res;
+}
+
+/*
+ * Pushes everything out of CPU caches of the calling thread by reading a
+ * buffer twice as big as the last level cache, a load per cache line. The
+ * buffer is written once when it is made, untouched pages would all be
+ * the same zero page.
+ */
+class CacheEvictor {
+public:
+	static constexpr size_t CACHE_LINE = 64;
+	static constexpr size_t DEFAULT_SIZE = 64 * 1024 * 1024;
+
+	CacheEvictor()
+	{
+		size_t llc = last_level_cache_size();
+		m_Size = llc == 0 ? DEFAULT_SIZE : 2 * llc;
+		m_Buf = m_Arena.get(m_Size);
+		memset(m_Buf, 1, m_Size);
+	}
+
+	/* Evicts, returns the time it took. */
+	std::chrono::high_resolution_clock::duration evict() const
+	{
+		using namespace std::chrono;
+		auto start = high_resolution_clock::now();
+		uint64_t sum = 0;
+		for (size_t i = 0; i < m_Size; i += CACHE_LINE)
+			sum += *(volatile char *)(m_Buf + i);
+		m_Sink = sum;
+		return high_resolution_clock::now() - start;
+	}
+
+	size_t size() const
+	{
+		return m_Size;
+	}
+
+private:
+	DataArena m_Arena;
+	char *m_Buf;
+	size_t m_Size;
+	mutable volatile uint64_t m_Sink = 0;
+};
+
+/*
+ * Eviction that a cold run asks of test loops of the calling thread:
+ * every @every operations, none if it is 0. Time that evictions take is
+ * summed, to be taken out of the result.
+ */
+struct EvictSchedule {
+	size_t every = 0;
+	std::chrono::high_resolution_clock::duration evicted{};
+
+	void start(size_t evict_every)
+	{
+		every = evict_every;
+		evicted = {};
+	}
+
+	static EvictSchedule& local()
+	{
+		static thread_local EvictSchedule schedule;
+		return schedule;
+	}
+};
+
+/* The one of the process, made when it is first needed. */
+inline const CacheEvictor& cache_evictor()
+{
+	static CacheEvictor evictor;
+	return evictor;
+}
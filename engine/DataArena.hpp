@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <string>
+
+/*
+ * Pages that test data (keys, strings, query streams) is mapped with:
+ *  4k      - base pages;
+ *  thp     - transparent huge pages, asked for with madvise;
+ *  hugetlb - pages of the hugetlbfs pool, thp if the pool is short.
+ */
+enum DataPages : uint8_t {
+	PAGES_4K,
+	PAGES_THP,
+	PAGES_HUGETLB,
+	DATA_PAGES_COUNT
+};
+
+static constexpr const char *data_pages_names[DATA_PAGES_COUNT] = {
+	"4k", "thp", "hugetlb",
+};
+
+inline bool parse_data_pages(const std::string& str, DataPages& pages)
+{
+	for (size_t i = 0; i < DATA_PAGES_COUNT; i++) {
+		if (str == data_pages_names[i]) {
+			pages = DataPages(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Pages that are asked for and pages that mappings actually got. */
+inline DataPages& wanted_data_pages()
+{
+	static DataPages pages = PAGES_4K;
+	return pages;
+}
+
+inline DataPages& used_data_pages()
+{
+	static DataPages pages = PAGES_4K;
+	return pages;
+}
+
+/* Size of a huge page, 2M if the kernel does not tell. */
+inline size_t huge_page_size()
+{
+	static size_t size = [] {
+		std::ifstream in("/proc/meminfo");
+		std::string key;
+		size_t kb;
+		while (in >> key >> kb) {
+			if (key == "Hugepagesize:")
+				return kb * 1024;
+			in.ignore(256, '\n');
+		}
+		return size_t(2 * 1024 * 1024);
+	}();
+	return size;
+}
+
+/* Whether the kernel gives transparent huge pages on madvise. */
+inline bool thp_available()
+{
+	std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+	std::string mode;
+	if (!std::getline(in, mode))
+		return false;
+	return mode.find("[never]") == std::string::npos;
+}
+
+/* Page size of test data as it is reported, like "2M thp". */
+inline std::string data_pages_report()
+{
+	if (used_data_pages() == PAGES_4K)
+		return "4k";
+	return std::to_string(huge_page_size() >> 20) + "M " +
+	       data_pages_names[used_data_pages()];
+}
+
+/*
+ * Map @size bytes of test data with the pages that are asked for, rounded
+ * up to the page size that is stored in @mapped. Base and transparent
+ * pages are not reserved and populated on first touch, hugetlb pages are
+ * reserved by mmap, so the pool shortage is seen here and not as SIGBUS.
+ */
+inline void *map_data(size_t size, size_t& mapped)
+{
+	const size_t huge = huge_page_size();
+	if (wanted_data_pages() == PAGES_HUGETLB) {
+		mapped = (size + huge - 1) / huge * huge;
+		void *mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+				 -1, 0);
+		if (mem != MAP_FAILED) {
+			used_data_pages() = PAGES_HUGETLB;
+			return mem;
+		}
+	}
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	if (wanted_data_pages() == PAGES_4K || !thp_available()) {
+		mapped = (size + 4095) / 4096 * 4096;
+		void *mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+				 flags, -1, 0);
+		if (mem == MAP_FAILED)
+			throw std::bad_alloc();
+		used_data_pages() = PAGES_4K;
+		return mem;
+	}
+	/* Huge pages need huge alignment, the excess is cut off. */
+	mapped = (size + huge - 1) / huge * huge;
+	char *mem = (char *)mmap(nullptr, mapped + huge, PROT_READ | PROT_WRITE,
+				 flags, -1, 0);
+	if (mem == MAP_FAILED)
+		throw std::bad_alloc();
+	char *res = (char *)(((uintptr_t)mem + huge - 1) / huge * huge);
+	if (res != mem)
+		munmap(mem, res - mem);
+	munmap(res + mapped, mem + huge - res);
+	madvise(res, mapped, MADV_HUGEPAGE);
+	used_data_pages() = PAGES_THP;
+	return res;
+}
+
+/* Ask for pages of test data and find out what is given with a probe. */
+inline void select_data_pages(DataPages pages)
+{
+	wanted_data_pages() = pages;
+	size_t size;
+	void *probe = map_data(1, size);
+	munmap(probe, size);
+}
+
+/* Bytes of test data in arenas, they are resident once written. */
+inline size_t& data_arena_bytes()
+{
+	static size_t bytes = 0;
+	return bytes;
+}
+
+/*
+ * Memory for test data. It is mapped, not allocated with malloc, to stay
+ * out of memory measurement of the tested struct, and it is as large as
+ * the biggest request so far, so no size limit is built in. The pages
+ * that are written are accounted in data_arena_bytes().
+ */
+class DataArena {
+public:
+	DataArena() = default;
+	DataArena(const DataArena&) = delete;
+	DataArena& operator=(const DataArena&) = delete;
+	~DataArena()
+	{
+		release();
+	}
+
+	/*
+	 * At least @size bytes, the content is lost if it is remapped. Only
+	 * bytes from @from on are to be written, pages before are not
+	 * accounted unless they were written before.
+	 */
+	char *get(size_t size, size_t from = 0)
+	{
+		if (size > m_Size) {
+			release();
+			m_Data = (char *)map_data(size, m_Size);
+			m_Page = used_data_pages() == PAGES_4K ? 4096 :
+				 huge_page_size();
+		}
+		size_t begin = from / m_Page * m_Page;
+		size_t end = std::max(begin, roundUp(size));
+		if (m_End > m_Begin) {
+			begin = std::min(begin, m_Begin);
+			end = std::max(end, m_End);
+		}
+		account(begin, end);
+		return m_Data;
+	}
+
+	/* Give back pages past @size bytes, they are zero if touched again. */
+	void trim(size_t size)
+	{
+		size_t from = roundUp(size);
+		if (from < m_Size)
+			madvise(m_Data + from, m_Size - from, MADV_DONTNEED);
+		if (from < m_End)
+			account(std::min(m_Begin, from), from);
+	}
+
+	void release()
+	{
+		if (m_Data != nullptr)
+			munmap(m_Data, m_Size);
+		account(0, 0);
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+
+private:
+	size_t roundUp(size_t size) const
+	{
+		return std::min((size + m_Page - 1) / m_Page * m_Page, m_Size);
+	}
+
+	/* Pages [begin, end) are written. */
+	void account(size_t begin, size_t end)
+	{
+		data_arena_bytes() -= m_End - m_Begin;
+		data_arena_bytes() += end - begin;
+		m_Begin = begin;
+		m_End = end;
+	}
+
+	char *m_Data = nullptr;
+	size_t m_Size = 0;
+	size_t m_Page = 4096;
+	size_t m_Begin = 0;
+	size_t m_End = 0;
+};
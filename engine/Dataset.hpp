@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <DataArena.hpp>
+#include <MemMeasurer.hpp>
+#include <Types.hpp>
+#include <Workers.hpp>
+
+/* The i-th number of a random stream, it depends only on the seed and i. */
+inline uint64_t counter_rand(uint64_t seed, uint64_t i)
+{
+	return mix64(seed + (i + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+/*
+ * Keys of tests: COUNT keys made of random numbers below MAX and strings
+ * the keys refer to. Keys are made in CHUNKS parts by as many threads as
+ * there are cores, a key depends only on its index, so the data is the
+ * same from run to run whatever the number of threads.
+ */
+class Dataset {
+public:
+	static constexpr size_t CHUNKS = 64;
+	/* Fewer keys are made by one thread. */
+	static constexpr size_t PARALLEL_MIN = 64 * 1024;
+	static constexpr uint64_t SEED = 0;
+	/* Files of another layout or generator are made anew. */
+	static constexpr uint64_t VERSION = 1;
+
+	/* Head of a file, followed by the keys and the strings. */
+	struct Header {
+		char magic[8];
+		uint64_t version;
+		uint64_t key_size;
+		uint64_t count;
+		uint64_t max;
+		uint64_t string_size;
+		uint64_t reserved[2];
+	};
+
+	Dataset(const char *type, size_t count, size_t max)
+		: m_Type(type), m_Count(count), m_Max(max) {}
+	Dataset(const Dataset&) = delete;
+	Dataset& operator=(const Dataset&) = delete;
+
+	bool is(const char *type, size_t count, size_t max) const
+	{
+		return strcmp(m_Type, type) == 0 && m_Count == count &&
+		       m_Max == max;
+	}
+
+	template <typename TYPE>
+	const TYPE *keys() const
+	{
+		return (const TYPE *)m_Keys;
+	}
+
+	template <typename TYPE>
+	void generate();
+	template <typename TYPE>
+	bool load(const std::string& path);
+	template <typename TYPE>
+	bool save(const std::string& path);
+
+	/* Tick of the last use, the least recently used set is dropped. */
+	uint64_t used = 0;
+
+private:
+	template <typename TYPE>
+	Header header() const;
+	/* Keys refer to strings by pointers in memory, by offsets in a file. */
+	template <typename TYPE>
+	void relocate(const char *from, const char *to);
+
+	const char *m_Type;
+	size_t m_Count;
+	size_t m_Max;
+	DataArena m_KeyArena;
+	DataArena m_StringArena;
+	char *m_Keys = nullptr;
+	char *m_Strings = nullptr;
+	size_t m_StringSize = 0;
+};
+
+template <typename TYPE>
+void Dataset::generate()
+{
+	using Traits = TypeTraits<TYPE>;
+	constexpr size_t STRING_SIZE = Traits::STRING_SIZE;
+	TYPE *keys = (TYPE *)m_KeyArena.get(m_Count * sizeof(TYPE));
+	m_Keys = (char *)keys;
+	if (STRING_SIZE != 0)
+		m_Strings = m_StringArena.get(m_Count * STRING_SIZE);
+
+	size_t ends[CHUNKS];
+	auto chunk = [&](size_t c) {
+		size_t begin = m_Count * c / CHUNKS;
+		size_t end = m_Count * (c + 1) / CHUNKS;
+		char *strings = m_Strings + begin * STRING_SIZE;
+		for (size_t i = begin; i < end; i++)
+			keys[i] = Traits::gen(counter_rand(SEED, i) % m_Max,
+					      strings);
+		ends[c] = strings - m_Strings;
+	};
+	size_t threads = std::min<size_t>(std::thread::hardware_concurrency(),
+					  CHUNKS);
+	if (m_Count < PARALLEL_MIN || threads <= 1) {
+		for (size_t c = 0; c < CHUNKS; c++)
+			chunk(c);
+	} else {
+		Workers workers(threads, false);
+		workers.run([&](size_t id) {
+			for (size_t c = id; c < CHUNKS; c += threads)
+				chunk(c);
+		});
+	}
+
+	if constexpr (STRING_SIZE != 0) {
+		/* Strings of chunks are moved together, the rest is freed. */
+		size_t pos = 0;
+		for (size_t c = 0; c < CHUNKS; c++) {
+			size_t begin = m_Count * c / CHUNKS;
+			size_t end = m_Count * (c + 1) / CHUNKS;
+			size_t from = begin * STRING_SIZE;
+			if (from != pos) {
+				memmove(m_Strings + pos, m_Strings + from,
+					ends[c] - from);
+				for (size_t i = begin; i < end; i++)
+					keys[i].core -= from - pos;
+			}
+			pos += ends[c] - from;
+		}
+		m_StringSize = pos;
+		m_StringArena.trim(m_StringSize);
+		/*
+		 * Keys are random, but their strings lie in the same order,
+		 * so keys are shuffled for strings to be accessed at random.
+		 */
+		for (size_t i = m_Count - 1; i > 0; i--)
+			std::swap(keys[i], keys[counter_rand(SEED + 1, i) % (i + 1)]);
+	}
+}
+
+template <typename TYPE>
+Dataset::Header Dataset::header() const
+{
+	Header h{};
+	memcpy(h.magic, "DSDATA\0\0", sizeof(h.magic));
+	h.version = VERSION;
+	h.key_size = sizeof(TYPE);
+	h.count = m_Count;
+	h.max = m_Max;
+	h.string_size = m_StringSize;
+	return h;
+}
+
+template <typename TYPE>
+void Dataset::relocate(const char *from, const char *to)
+{
+	if constexpr (TypeTraits<TYPE>::STRING_SIZE != 0) {
+		static_assert(std::is_base_of_v<char_ptr, TYPE>,
+			      "strings are referred by char_ptr");
+		TYPE *keys = (TYPE *)m_Keys;
+		for (size_t i = 0; i < m_Count; i++)
+			keys[i].core = (const char *)((uintptr_t)keys[i].core -
+						      (uintptr_t)from +
+						      (uintptr_t)to);
+	}
+}
+
+/*
+ * The file is mapped and copied to arenas, so the data is on the pages
+ * that are asked for, as if it was generated.
+ */
+template <typename TYPE>
+bool Dataset::load(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	size_t size = st.st_size;
+	void *mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+			 fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return false;
+
+	Header h;
+	memcpy(&h, mem, sizeof(h));
+	Header want = header<TYPE>();
+	size_t key_size = m_Count * sizeof(TYPE);
+	bool ok = memcmp(h.magic, want.magic, sizeof(h.magic)) == 0 &&
+		  h.version == want.version && h.key_size == want.key_size &&
+		  h.count == want.count && h.max == want.max &&
+		  size == sizeof(h) + key_size + h.string_size;
+	if (ok) {
+		const char *data = (const char *)mem + sizeof(h);
+		m_Keys = m_KeyArena.get(key_size);
+		memcpy(m_Keys, data, key_size);
+		m_StringSize = h.string_size;
+		if (m_StringSize != 0) {
+			m_Strings = m_StringArena.get(m_StringSize);
+			memcpy(m_Strings, data + key_size, m_StringSize);
+		}
+		relocate<TYPE>(nullptr, m_Strings);
+	}
+	munmap(mem, size);
+	return ok;
+}
+
+/* Written aside and renamed, so a file is either complete or absent. */
+template <typename TYPE>
+bool Dataset::save(const std::string& path)
+{
+	std::string tmp = path + ".tmp";
+	Header h = header<TYPE>();
+	relocate<TYPE>(m_Strings, nullptr);
+	std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+	out.write((const char *)&h, sizeof(h));
+	out.write(m_Keys, m_Count * sizeof(TYPE));
+	out.write(m_Strings, m_StringSize);
+	out.close();
+	relocate<TYPE>(nullptr, m_Strings);
+	if (!out || rename(tmp.c_str(), path.c_str()) != 0) {
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Datasets shared by tests, so structs of a size and type are run with the
+ * data made once. A few recent datasets are kept, with a directory set
+ * they are also saved there and read back by later runs. Tests get them
+ * while measured, the cache allocates and frees with the measurer paused.
+ */
+class DatasetCache {
+public:
+	static constexpr size_t CAPACITY = 4;
+
+	void setDir(const std::string& dir)
+	{
+		m_Dir = dir;
+	}
+
+	template <typename TYPE>
+	const TYPE *get(size_t count, size_t max)
+	{
+		MemMeasurer::Pause pause;
+		const char *type = TypeTraits<TYPE>::name;
+		m_Tick++;
+		for (const auto& set : m_Sets) {
+			if (set->is(type, count, max)) {
+				set->used = m_Tick;
+				return set->template keys<TYPE>();
+			}
+		}
+		if (m_Sets.size() == CAPACITY) {
+			auto lru = std::min_element(m_Sets.begin(), m_Sets.end(),
+				[](const auto& a, const auto& b) {
+					return a->used < b->used;
+				});
+			m_Sets.erase(lru);
+		}
+
+		auto set = std::make_unique<Dataset>(type, count, max);
+		set->used = m_Tick;
+		std::string path = m_Dir.empty() ? "" :
+				   m_Dir + "/" + fileName(type, count, max);
+		if (path.empty() || !set->template load<TYPE>(path)) {
+			set->template generate<TYPE>();
+			if (!path.empty() && !set->template save<TYPE>(path))
+				std::cout << "Failed to save " << path << std::endl;
+		}
+		m_Sets.push_back(std::move(set));
+		return m_Sets.back()->template keys<TYPE>();
+	}
+
+private:
+	static std::string fileName(const char *type, size_t count, size_t max)
+	{
+		std::string name = type;
+		for (char& c : name) {
+			if (!isalnum((unsigned char)c))
+				c = '_';
+		}
+		return name + "-" + std::to_string(count) + "-" +
+		       std::to_string(max) + ".data";
+	}
+
+	std::string m_Dir;
+	std::vector<std::unique_ptr<Dataset>> m_Sets;
+	uint64_t m_Tick = 0;
+};
+
+inline DatasetCache& dataset_cache()
+{
+	static DatasetCache cache;
+	return cache;
+}
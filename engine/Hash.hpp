@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE4_2__) || defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include <PMurHash.h>
+
+/*
+ * Hash functions a run can be done with. Keys of fixed size and strings
+ * are hashed as bytes, 64-bit integers have their own variants:
+ *  default - identity for integers and murmur3 for bytes;
+ *  murmur3 - 32-bit MurmurHash3, its 64-bit finalizer for integers;
+ *  wyhash  - 64-bit wyhash, multiply-and-fold of 128-bit products;
+ *  crc32c  - CRC32C with SSE4.2 instructions if the CPU has them;
+ *  mult    - multiplicative (Fibonacci) hashing with a final fold.
+ */
+enum HashKind : uint8_t {
+	HASH_DEFAULT,
+	HASH_MURMUR3,
+	HASH_WYHASH,
+	HASH_CRC32C,
+	HASH_MULT,
+	HASH_KIND_COUNT
+};
+
+static constexpr const char *hash_kind_names[HASH_KIND_COUNT] = {
+	"default", "murmur3", "wyhash", "crc32c", "mult",
+};
+
+inline bool parse_hash_kind(const std::string& str, HashKind& kind)
+{
+	for (size_t i = 0; i < HASH_KIND_COUNT; i++) {
+		if (str == hash_kind_names[i]) {
+			kind = HashKind(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Hash function of the current run, set by the runner. */
+inline HashKind& current_hash()
+{
+	static HashKind kind = HASH_DEFAULT;
+	return kind;
+}
+
+namespace hashing {
+
+enum {
+	MURMUR3_SEED = 13U
+};
+
+static constexpr uint64_t FIBONACCI = 0x9e3779b97f4a7c15ULL;
+static constexpr uint64_t WY_SECRET[4] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL,
+};
+
+inline uint32_t murmur3(const char *data, size_t size)
+{
+	return PMurHash32(MURMUR3_SEED, data, size);
+}
+
+/* MurmurHash3 fmix64. */
+inline uint64_t murmur3(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+inline uint64_t wymix(uint64_t a, uint64_t b)
+{
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+inline uint64_t read8(const char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint64_t read4(const char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* wyhash (final version 4) with the default secret and seed 0. */
+inline uint64_t wyhash(const char *p, size_t size)
+{
+	const uint64_t *s = WY_SECRET;
+	uint64_t seed = wymix(s[0], s[1]);
+	uint64_t a, b;
+	if (size <= 16) {
+		if (size >= 4) {
+			size_t mid = (size >> 3) << 2;
+			a = (read4(p) << 32) | read4(p + mid);
+			b = (read4(p + size - 4) << 32) | read4(p + size - 4 - mid);
+		} else if (size > 0) {
+			const uint8_t *u = (const uint8_t *)p;
+			a = ((uint64_t)u[0] << 16) | ((uint64_t)u[size >> 1] << 8) |
+			    u[size - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = size;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = wymix(read8(p) ^ s[1], read8(p + 8) ^ seed);
+				see1 = wymix(read8(p + 16) ^ s[2], read8(p + 24) ^ see1);
+				see2 = wymix(read8(p + 32) ^ s[3], read8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wymix(read8(p) ^ s[1], read8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = read8(p + i - 16);
+		b = read8(p + i - 8);
+	}
+	__uint128_t r = (__uint128_t)(a ^ s[1]) * (b ^ seed);
+	return wymix((uint64_t)r ^ s[0] ^ size, (uint64_t)(r >> 64) ^ s[1]);
+}
+
+/* wyhash64 of the integer and a secret word. */
+inline uint64_t wyhash(uint64_t x)
+{
+	__uint128_t r = (__uint128_t)(x ^ WY_SECRET[0]) * (WY_SECRET[2] ^ WY_SECRET[1]);
+	return wymix((uint64_t)r ^ WY_SECRET[0], (uint64_t)(r >> 64) ^ WY_SECRET[1]);
+}
+
+/* Castagnoli polynomial, reversed. */
+static constexpr uint32_t CRC32C_POLY = 0x82f63b78;
+
+inline uint32_t crc32c_soft(uint32_t crc, const char *p, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint8_t)p[i];
+		for (int k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+	}
+	return crc;
+}
+
+#if defined(__SSE4_2__) || defined(__x86_64__)
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_hw(uint32_t crc, const char *p, size_t size)
+{
+	uint64_t c = crc;
+	for (; size >= 8; size -= 8, p += 8)
+		c = _mm_crc32_u64(c, read8(p));
+	crc = c;
+	for (; size > 0; size--, p++)
+		crc = _mm_crc32_u8(crc, *p);
+	return crc;
+}
+
+inline bool crc32c_hw_supported()
+{
+	static const bool supported = __builtin_cpu_supports("sse4.2");
+	return supported;
+}
+#endif
+
+inline uint32_t crc32c(const char *p, size_t size)
+{
+#if defined(__SSE4_2__)
+	return ~crc32c_hw(~0U, p, size);
+#elif defined(__x86_64__)
+	if (crc32c_hw_supported())
+		return ~crc32c_hw(~0U, p, size);
+	return ~crc32c_soft(~0U, p, size);
+#else
+	return ~crc32c_soft(~0U, p, size);
+#endif
+}
+
+inline uint32_t crc32c(uint64_t x)
+{
+	return crc32c((const char *)&x, sizeof(x));
+}
+
+inline uint64_t mult(uint64_t x)
+{
+	x *= FIBONACCI;
+	return x ^ (x >> 32);
+}
+
+/* Words are mixed in one by one, the tail is padded with zeros. */
+inline uint64_t mult(const char *p, size_t size)
+{
+	uint64_t h = size;
+	for (; size >= 8; size -= 8, p += 8)
+		h = (h ^ read8(p)) * FIBONACCI;
+	if (size > 0) {
+		uint64_t tail = 0;
+		memcpy(&tail, p, size);
+		h = (h ^ tail) * FIBONACCI;
+	}
+	return h ^ (h >> 32);
+}
+
+} // namespace hashing {
+
+/*
+ * Hash of an integer and of size bytes at data with the hash function of
+ * the run or the given one. The functions are inlined into the switch and
+ * the kind stays the same for a whole run, so the branch is predicted,
+ * and it is folded away where the kind is a constant.
+ */
+inline uint64_t hash_int(uint64_t x, HashKind kind = current_hash())
+{
+	switch (kind) {
+	case HASH_DEFAULT:
+		return x;
+	case HASH_MURMUR3:
+		return hashing::murmur3(x);
+	case HASH_WYHASH:
+		return hashing::wyhash(x);
+	case HASH_CRC32C:
+		return hashing::crc32c(x);
+	default:
+		return hashing::mult(x);
+	}
+}
+
+inline uint64_t hash_bytes(const char *data, size_t size,
+			   HashKind kind = current_hash())
+{
+	switch (kind) {
+	case HASH_DEFAULT:
+	case HASH_MURMUR3:
+		return hashing::murmur3(data, size);
+	case HASH_WYHASH:
+		return hashing::wyhash(data, size);
+	case HASH_CRC32C:
+		return hashing::crc32c(data, size);
+	default:
+		return hashing::mult(data, size);
+	}
+}
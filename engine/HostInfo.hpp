@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <DataArena.hpp>
+#include <MemMeasurer.hpp>
+
+#ifndef BUILD_TYPE
+#define BUILD_TYPE "unknown"
+#endif
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"
+#endif
+
+/*
+ * Frequency scaling governor of the CPUs, "mixed" if they differ and
+ * "unknown" if there is no cpufreq.
+ */
+inline std::string cpu_governor()
+{
+	std::string res;
+	for (size_t cpu = 0; ; cpu++) {
+		std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+				 "/cpufreq/scaling_governor");
+		std::string governor;
+		if (!std::getline(in, governor))
+			break;
+		if (res.empty())
+			res = governor;
+		else if (res != governor)
+			res = "mixed";
+	}
+	return res.empty() ? "unknown" : res;
+}
+
+/* Description of the machine and the build, written along with results. */
+inline std::vector<std::pair<const char *, std::string>> host_info()
+{
+	std::string cpu = "unknown";
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line)) {
+		if (line.compare(0, 10, "model name") != 0)
+			continue;
+		size_t pos = line.find(':');
+		if (pos != std::string::npos)
+			cpu = line.substr(line.find_first_not_of(' ', pos + 1));
+		break;
+	}
+
+	struct utsname uts;
+	std::string kernel = "unknown", host = "unknown";
+	if (uname(&uts) == 0) {
+		kernel = std::string(uts.sysname) + " " + uts.release;
+		host = uts.nodename;
+	}
+
+	char date[32];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+#if defined(__clang__)
+	std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+	std::string compiler = "gcc " __VERSION__;
+#else
+	std::string compiler = "unknown";
+#endif
+
+	return {
+		{"date", date},
+		{"host", host},
+		{"kernel", kernel},
+		{"cpu", cpu},
+		{"cpus", std::to_string(sysconf(_SC_NPROCESSORS_ONLN))},
+		{"governor", cpu_governor()},
+		{"compiler", compiler},
+		{"build_type", BUILD_TYPE},
+		{"flags", BUILD_FLAGS},
+		{"data_pages", data_pages_report()},
+		{"mem_measure", MemMeasurer::enabled() ? "on" : "off"},
+	};
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <StructTraits.hpp>
+
+/*
+ * Time stamp counter: tick() to start and tock() to stop an interval,
+ * both ordered against surrounding instructions. Where there is no TSC
+ * steady clock nanoseconds are used instead.
+ */
+struct Tsc {
+#if defined(__x86_64__) || defined(__i386__)
+	static uint64_t tick()
+	{
+		_mm_lfence();
+		return __rdtsc();
+	}
+	static uint64_t tock()
+	{
+		unsigned aux;
+		uint64_t t = __rdtscp(&aux);
+		_mm_lfence();
+		return t;
+	}
+#else
+	static uint64_t tick()
+	{
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(
+			steady_clock::now().time_since_epoch()).count();
+	}
+	static uint64_t tock()
+	{
+		return tick();
+	}
+#endif
+
+	/* Must be called once before the values below are used. */
+	static void calibrate()
+	{
+		using namespace std::chrono;
+		auto t0 = steady_clock::now();
+		uint64_t c0 = tick();
+		while (steady_clock::now() - t0 < milliseconds(50))
+			;
+		uint64_t c1 = tock();
+		auto t1 = steady_clock::now();
+		double ns = duration_cast<duration<double, std::nano>>(t1 - t0).count();
+		ticksPerNs() = (c1 - c0) / ns;
+
+		/* Median cost of timing nothing. */
+		std::vector<uint64_t> empty(1001);
+		for (uint64_t& e : empty) {
+			uint64_t s = tick();
+			e = tock() - s;
+		}
+		std::nth_element(empty.begin(), empty.begin() + empty.size() / 2,
+				 empty.end());
+		overhead() = empty[empty.size() / 2];
+	}
+	static double& ticksPerNs() { static double v = 1; return v; }
+	static uint64_t& overhead() { static uint64_t v = 0; return v; }
+};
+
+/*
+ * Log-bucketed histogram in the spirit of HdrHistogram: every power of two
+ * range is split into 2^SUB_BITS equal buckets, so any value is kept with
+ * relative error below 2^-SUB_BITS.
+ */
+class Histogram {
+public:
+	static constexpr size_t SUB_BITS = 5;
+	static constexpr size_t SUB = 1 << SUB_BITS;
+	static constexpr size_t BUCKETS = (64 - SUB_BITS) * SUB + SUB;
+
+	void record(uint64_t v, size_t times = 1)
+	{
+		m_Counts[bucket(v)] += times;
+		m_Total += times;
+		m_Max = std::max(m_Max, v);
+	}
+	void merge(const Histogram& other)
+	{
+		for (size_t i = 0; i < BUCKETS; i++)
+			m_Counts[i] += other.m_Counts[i];
+		m_Total += other.m_Total;
+		m_Max = std::max(m_Max, other.m_Max);
+	}
+	void clear()
+	{
+		std::fill(std::begin(m_Counts), std::end(m_Counts), 0);
+		m_Total = 0;
+		m_Max = 0;
+	}
+	size_t count() const
+	{
+		return m_Total;
+	}
+	uint64_t max() const
+	{
+		return m_Max;
+	}
+	/* Value below which are the given share (0..1) of records. */
+	double percentile(double p) const
+	{
+		if (m_Total == 0)
+			return 0;
+		size_t rank = std::max<size_t>(1, p * m_Total + 0.5);
+		size_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; i++) {
+			seen += m_Counts[i];
+			if (seen >= rank)
+				return std::min<double>(middle(i), m_Max);
+		}
+		return m_Max;
+	}
+
+private:
+	static size_t bucket(uint64_t v)
+	{
+		if (v < 2 * SUB)
+			return v;
+		size_t shift = 63 - __builtin_clzll(v) - SUB_BITS;
+		return shift * SUB + (v >> shift);
+	}
+	static double middle(size_t i)
+	{
+		if (i < 2 * SUB)
+			return i;
+		size_t shift = i / SUB - 1;
+		uint64_t low = uint64_t(i - shift * SUB) << shift;
+		return low + ((uint64_t(1) << shift) - 1) / 2.;
+	}
+
+	uint64_t m_Counts[BUCKETS] = {};
+	size_t m_Total = 0;
+	uint64_t m_Max = 0;
+};
+
+/* Latency statistics reported for a test. */
+enum LatencyStat {
+	LATENCY_P50,
+	LATENCY_P90,
+	LATENCY_P99,
+	LATENCY_P999,
+	LATENCY_MAX,
+	LATENCY_STAT_COUNT
+};
+
+/* Fill the statistics in nanoseconds, NaN if nothing was recorded. */
+inline void latency_stats(const Histogram& histogram,
+			  double (&ns)[LATENCY_STAT_COUNT])
+{
+	static constexpr double shares[] = {0.5, 0.9, 0.99, 0.999};
+	if (histogram.count() == 0) {
+		std::fill(std::begin(ns), std::end(ns), NAN);
+		return;
+	}
+	for (int i = 0; i < LATENCY_MAX; i++)
+		ns[i] = histogram.percentile(shares[i]) / Tsc::ticksPerNs();
+	ns[LATENCY_MAX] = histogram.max() / Tsc::ticksPerNs();
+}
+
+/*
+ * Where latencies of the calling thread go: every BATCH operations of a
+ * LatencyStruct are timed together, calibrated timing overhead is
+ * subtracted and the average per operation is recorded in ticks. With no
+ * histogram nothing is timed.
+ */
+struct LatencyRecorder {
+	Histogram *histogram = nullptr;
+	size_t batch = 1;
+	size_t pending = 0;
+	uint64_t start = 0;
+
+	void attach(Histogram *h, size_t batch_size)
+	{
+		histogram = h;
+		batch = batch_size;
+		pending = 0;
+	}
+
+	static LatencyRecorder& local()
+	{
+		static thread_local LatencyRecorder recorder;
+		return recorder;
+	}
+};
+
+/* Struct wrapper that records latencies of every operation. */
+template <typename TYPE, class STRUCT>
+struct LatencyStruct {
+	bool insert(const TYPE& t)
+	{
+		return measure([&] { return m_Core.insert(t); });
+	}
+	bool remove(const TYPE& t)
+	{
+		return measure([&] { return m_Core.remove(t); });
+	}
+	bool has(const TYPE& t) const
+	{
+		return measure([&] { return m_Core.has(t); });
+	}
+	/* Batches are timed as a whole, every key gets the average. */
+	void has_batch(const TYPE *keys, size_t count, bool *res) const
+	{
+		measureBatch(count, [&] { struct_has_batch(m_Core, keys, count, res); });
+	}
+	void insert_batch(const TYPE *keys, size_t count, bool *res)
+	{
+		measureBatch(count, [&] { struct_insert_batch(m_Core, keys, count, res); });
+	}
+	void bulk_load(const TYPE *first, const TYPE *last, bool sorted)
+	{
+		measureBatch(last - first,
+			     [&] { struct_bulk_load(m_Core, first, last, sorted); });
+	}
+	/* A scan is timed as one operation whatever its length. */
+	template <class S = STRUCT, class = std::enable_if_t<struct_is_ordered_v<S, TYPE>>>
+	bool lower_bound(const TYPE& t, TYPE& res) const
+	{
+		return measure([&] { return m_Core.lower_bound(t, res); });
+	}
+	template <class F, class S = STRUCT, class = std::enable_if_t<struct_is_ordered_v<S, TYPE>>>
+	size_t scan(const TYPE& from, size_t k, F&& f) const
+	{
+		return measure([&] { return m_Core.scan(from, k, std::forward<F>(f)); });
+	}
+	template <class S = STRUCT, class = std::enable_if_t<struct_is_hashed_v<S, TYPE>>>
+	static uint64_t hash(const TYPE& t)
+	{
+		return measure([&] { return S::hash(t); });
+	}
+	void clear()
+	{
+		m_Core.clear();
+	}
+	size_t size() const
+	{
+		return m_Core.size();
+	}
+	static constexpr const char *family = STRUCT::family;
+	static constexpr const char *name = STRUCT::name;
+	static constexpr bool use = true;
+	static constexpr bool concurrent = struct_is_concurrent_v<STRUCT>;
+
+	template <class F>
+	static auto measure(F&& f)
+	{
+		LatencyRecorder& r = LatencyRecorder::local();
+		if (r.histogram == nullptr)
+			return f();
+		if (r.pending == 0)
+			r.start = Tsc::tick();
+		auto res = f();
+		if (++r.pending == r.batch) {
+			uint64_t t = Tsc::tock() - r.start;
+			t = t > Tsc::overhead() ? t - Tsc::overhead() : 0;
+			r.histogram->record(t / r.batch);
+			r.pending = 0;
+		}
+		return res;
+	}
+
+	template <class F>
+	static void measureBatch(size_t count, F&& f)
+	{
+		LatencyRecorder& r = LatencyRecorder::local();
+		if (r.histogram == nullptr) {
+			f();
+			return;
+		}
+		uint64_t start = Tsc::tick();
+		f();
+		uint64_t t = Tsc::tock() - start;
+		t = t > Tsc::overhead() ? t - Tsc::overhead() : 0;
+		if (count != 0)
+			r.histogram->record(t / count, count);
+	}
+
+	STRUCT m_Core;
+};
@@ -1,14 +1,164 @@
 #include <MemMeasurer.hpp>
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
 
-struct MemStats
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Allocation statistics are kept per thread, so that allocating threads
+ * neither race nor fight for a cache line: a thread owns a slot that only
+ * it modifies (with plain loads and stores), readers sum all the slots.
+ * Memory freed by another thread than allocated it makes slot counters
+ * negative, but the sum is still exact. A slot is returned on thread exit
+ * with its counters and reused by a new thread. If there are more threads
+ * than slots the rest share the last one and update it atomically.
+ */
+struct alignas(64) MemStats
 {
-	size_t count;
-	size_t size;
+	/* Blocks and bytes in use. */
+	std::atomic<int64_t> count;
+	std::atomic<int64_t> size;
+	/* Most bytes in use since the last MemMeasurer::resetPeak(). */
+	std::atomic<int64_t> peak;
+	/* Calls to the allocator and time spent in them. */
+	std::atomic<int64_t> allocs;
+	std::atomic<int64_t> frees;
+	std::atomic<int64_t> ticks;
+	std::atomic<bool> owned;
 };
 
-MemStats MemStatsInstance;
+static constexpr size_t MEM_STATS_SLOTS = 256;
+static MemStats MemStatsSlots[MEM_STATS_SLOTS + 1];
+static MemStats& MemStatsShared = MemStatsSlots[MEM_STATS_SLOTS];
+/* Slots that were ever used, only those are summed. */
+static std::atomic<size_t> MemStatsUsed;
+static thread_local MemStats *MemStatsLocal;
+static pthread_key_t MemStatsKey;
+static std::atomic<bool> MemStatsKeyReady;
+
+static void
+mem_stats_release(void *slot)
+{
+	/* Frees done later on thread exit go to the shared slot. */
+	MemStatsLocal = &MemStatsShared;
+	((MemStats *)slot)->owned.store(false, std::memory_order_release);
+}
+
+static struct MemStatsInit {
+	MemStatsInit()
+	{
+		if (pthread_key_create(&MemStatsKey, mem_stats_release) == 0)
+			MemStatsKeyReady = true;
+	}
+} MemStatsInitInstance;
+
+static MemStats *
+mem_stats_claim()
+{
+	for (size_t i = 0; i < MEM_STATS_SLOTS; i++) {
+		MemStats& slot = MemStatsSlots[i];
+		if (slot.owned.load(std::memory_order_relaxed) ||
+		    slot.owned.exchange(true, std::memory_order_acquire))
+			continue;
+		size_t used = MemStatsUsed.load();
+		while (used <= i && !MemStatsUsed.compare_exchange_weak(used, i + 1))
+			;
+		/* Threads started before the key is created keep the slot. */
+		if (MemStatsKeyReady)
+			pthread_setspecific(MemStatsKey, &slot);
+		return &slot;
+	}
+	return &MemStatsShared;
+}
+
+static inline void
+mem_stat_add(MemStats *stats, std::atomic<int64_t> MemStats::*field,
+	     int64_t val)
+{
+	std::atomic<int64_t>& stat = stats->*field;
+	if (stats == &MemStatsShared)
+		stat.fetch_add(val, std::memory_order_relaxed);
+	else
+		stat.store(stat.load(std::memory_order_relaxed) + val,
+			   std::memory_order_relaxed);
+}
+
+static inline void
+mem_stat_max(MemStats *stats, std::atomic<int64_t> MemStats::*field,
+	     int64_t val)
+{
+	std::atomic<int64_t>& stat = stats->*field;
+	int64_t cur = stat.load(std::memory_order_relaxed);
+	if (stats == &MemStatsShared) {
+		while (cur < val && !stat.compare_exchange_weak(cur, val,
+				std::memory_order_relaxed))
+			;
+	} else if (cur < val) {
+		stat.store(val, std::memory_order_relaxed);
+	}
+}
+
+/*
+ * One call to the allocator that changed blocks in use by count: a free
+ * if it is negative, an allocation (realloc too) otherwise.
+ */
+static inline void
+mem_stats_add(int64_t count, int64_t size, int64_t ticks)
+{
+	MemStats *stats = MemStatsLocal;
+	if (stats == nullptr)
+		stats = MemStatsLocal = mem_stats_claim();
+	mem_stat_add(stats, &MemStats::count, count);
+	mem_stat_add(stats, &MemStats::size, size);
+	if (size > 0)
+		mem_stat_max(stats, &MemStats::peak,
+			     stats->size.load(std::memory_order_relaxed));
+	mem_stat_add(stats, count < 0 ? &MemStats::frees : &MemStats::allocs, 1);
+	mem_stat_add(stats, &MemStats::ticks, ticks);
+}
+
+template <std::atomic<int64_t> MemStats::*FIELD>
+static double
+mem_stats_sum()
+{
+	if (!MemMeasurer::enabled())
+		return NAN;
+	int64_t sum = (MemStatsShared.*FIELD).load(std::memory_order_relaxed);
+	size_t used = MemStatsUsed.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < used; i++)
+		sum += (MemStatsSlots[i].*FIELD).load(std::memory_order_relaxed);
+	return sum;
+}
+
+#ifndef NO_MEM_MEASURE
+
+/*
+ * Blocks are given out as malloc gives them, with no header, so they keep
+ * its alignment and placement. Their size is the one malloc_usable_size
+ * tells, i.e. with malloc rounding: the size asked for is not known when
+ * a block is freed.
+ */
+template <class PARENT, class... ARGS>
+static inline void *
+mem_alloc(PARENT parent, ARGS... args)
+{
+	if (!MemMeasurer::enabled())
+		return parent(args...);
+	uint64_t start = MemMeasurer::clock();
+	void *res = parent(args...);
+	uint64_t ticks = MemMeasurer::clock() - start;
+	if (res != nullptr)
+		mem_stats_add(1, malloc_usable_size(res), ticks);
+	return res;
+}
 
 extern "C" {
 
@@ -17,28 +167,15 @@ malloc(size_t size)
 {
 	typedef void *(*parent_t)(size_t);
 	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "malloc");
-	size_t *res = (size_t *)parent(size + sizeof(size_t));
-	if (res == nullptr)
-		return nullptr;
-	*res = size;
-	MemStatsInstance.count++;
-	MemStatsInstance.size += size;
-	return res + 1;
+	return mem_alloc(parent, size);
 }
 
 void *
 calloc(size_t num, size_t elem_size)
 {
-	size_t size = num * elem_size;
-	typedef void *(*parent_t)(size_t);
+	typedef void *(*parent_t)(size_t, size_t);
 	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "calloc");
-	size_t *res = (size_t *)parent(size + sizeof(size_t));
-	if (res == nullptr)
-		return nullptr;
-	*res = size;
-	MemStatsInstance.count++;
-	MemStatsInstance.size += size;
-	return res + 1;
+	return mem_alloc(parent, num, elem_size);
 }
 
 void *
@@ -49,16 +186,19 @@ realloc(void *ptr, size_t size)
 
 	if (ptr == NULL)
 		return malloc(size);
+	if (!MemMeasurer::enabled())
+		return parent(ptr, size);
 
-	size_t *res = (size_t *)ptr - 1;
-	res = (size_t *)parent(res, size + sizeof(size_t));
-	if (res == nullptr)
-		return nullptr;
-
-	MemStatsInstance.size -= *res;
-	*res = size;
-	MemStatsInstance.size += *res;
-	return res + 1;
+	int64_t old_size = malloc_usable_size(ptr);
+	uint64_t start = MemMeasurer::clock();
+	void *res = parent(ptr, size);
+	uint64_t ticks = MemMeasurer::clock() - start;
+	if (res != nullptr)
+		mem_stats_add(0, (int64_t)malloc_usable_size(res) - old_size,
+			      ticks);
+	else if (size == 0)
+		mem_stats_add(-1, -old_size, ticks);
+	return res;
 }
 
 void free(void *ptr)
@@ -66,63 +206,140 @@ void free(void *ptr)
 	typedef void (*parent_t)(void*);
 	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "free");
 
-	if (ptr == nullptr)
+	if (ptr == nullptr || !MemMeasurer::enabled()) {
+		parent(ptr);
 		return;
-	size_t *res = (size_t *)ptr - 1;
-	MemStatsInstance.count--;
-	MemStatsInstance.size -= *res;
-	parent(res);
+	}
+	int64_t size = malloc_usable_size(ptr);
+	uint64_t start = MemMeasurer::clock();
+	parent(ptr);
+	mem_stats_add(-1, -size, MemMeasurer::clock() - start);
 }
 
-// Not implemented:
 void *
 memalign(size_t alignment, size_t size)
 {
-	(void)alignment;
-	(void)size;
-	return nullptr;
+	typedef void *(*parent_t)(size_t, size_t);
+	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "memalign");
+	return mem_alloc(parent, alignment, size);
 }
 
 int
 posix_memalign(void **memptr, size_t alignment, size_t size)
 {
-	(void)memptr;
-	(void)alignment;
-	(void)size;
-	return -1;
+	typedef int (*parent_t)(void **, size_t, size_t);
+	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "posix_memalign");
+	if (!MemMeasurer::enabled())
+		return parent(memptr, alignment, size);
+	uint64_t start = MemMeasurer::clock();
+	int rc = parent(memptr, alignment, size);
+	uint64_t ticks = MemMeasurer::clock() - start;
+	if (rc == 0)
+		mem_stats_add(1, malloc_usable_size(*memptr), ticks);
+	return rc;
 }
 
 void *
 aligned_alloc(size_t alignment, size_t size)
 {
-	(void)alignment;
-	(void)size;
-	return nullptr;
+	typedef void *(*parent_t)(size_t, size_t);
+	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "aligned_alloc");
+	return mem_alloc(parent, alignment, size);
 }
 
 void *
 valloc(size_t size)
 {
-	(void)size;
-	return nullptr;
+	typedef void *(*parent_t)(size_t);
+	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "valloc");
+	return mem_alloc(parent, size);
 }
 
 void *
 pvalloc(size_t size)
 {
-	(void)size;
-	return nullptr;
+	typedef void *(*parent_t)(size_t);
+	static parent_t parent = (parent_t)dlsym(RTLD_NEXT, "pvalloc");
+	return mem_alloc(parent, size);
 }
 
+} // extern "C" {
+
+#endif /* NO_MEM_MEASURE */
 
 double MemMeasurer::memUsed()
 {
-	return MemStatsInstance.size;
+	return mem_stats_sum<&MemStats::size>();
 }
 
 double MemMeasurer::countUsed()
 {
-	return MemStatsInstance.count;
+	return mem_stats_sum<&MemStats::count>();
 }
 
-} // extern "C" {
+/*
+ * Peaks are kept per slot, their sum is exact if one thread allocates
+ * and an upper bound of the peak of the process otherwise.
+ */
+double MemMeasurer::peakUsed()
+{
+	return mem_stats_sum<&MemStats::peak>();
+}
+
+void MemMeasurer::resetPeak()
+{
+	if (!enabled())
+		return;
+	auto reset = [](MemStats& slot) {
+		slot.peak.store(slot.size.load(std::memory_order_relaxed),
+				std::memory_order_relaxed);
+	};
+	reset(MemStatsShared);
+	size_t used = MemStatsUsed.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < used; i++)
+		reset(MemStatsSlots[i]);
+}
+
+AllocCalls MemMeasurer::allocCalls()
+{
+	return AllocCalls{mem_stats_sum<&MemStats::allocs>(),
+			  mem_stats_sum<&MemStats::frees>(),
+			  mem_stats_sum<&MemStats::ticks>()};
+}
+
+/*
+ * Read without streams: they allocate, and reads are done between
+ * probes of the bytes in use.
+ */
+ProcessMemory ProcessMemory::read()
+{
+	ProcessMemory res;
+	char buf[4096];
+	int fd = open("/proc/self/smaps_rollup", O_RDONLY);
+	if (fd < 0)
+		return res;
+	ssize_t len = ::read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return res;
+	buf[len] = 0;
+	for (char *line = buf; line != nullptr; ) {
+		char *next = strchr(line, '\n');
+		if (next != nullptr)
+			*next++ = 0;
+		if (strncmp(line, "Rss:", 4) == 0)
+			res.rss = strtod(line + 4, nullptr) * 1024;
+		else if (strncmp(line, "Pss:", 4) == 0)
+			res.pss = strtod(line + 4, nullptr) * 1024;
+		line = next;
+	}
+	return res;
+}
+
+double ProcessMemory::fragmentation()
+{
+	struct mallinfo2 info = mallinfo2();
+	size_t held = info.arena + info.hblkhd;
+	size_t used = info.uordblks + info.hblkhd;
+	return used == 0 ? NAN : (double)held / used;
+}
@@ -26,8 +26,40 @@
 
 #pragma once
 
+#include <malloc.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <DataArena.hpp>
 #include <Timer.hpp>
 
+/* Calls to malloc and free and time spent in them, ticks of a clock. */
+struct AllocCalls {
+	double allocs = 0;
+	double frees = 0;
+	double ticks = 0;
+
+	AllocCalls& operator+=(const AllocCalls& other)
+	{
+		allocs += other.allocs;
+		frees += other.frees;
+		ticks += other.ticks;
+		return *this;
+	}
+
+	AllocCalls operator-(const AllocCalls& other) const
+	{
+		return AllocCalls{allocs - other.allocs, frees - other.frees,
+				  ticks - other.ticks};
+	}
+};
+
 struct MemMeasurer {
 	MemMeasurer()
 	{
@@ -36,11 +68,34 @@ struct MemMeasurer {
 
 	void probe()
 	{
+		if (!enabled())
+			return;
 		double cur = memUsed();
 		if (cur > m_Max)
 			m_Max = cur;
 	}
 
+	/*
+	 * Account the most bytes that were in use since resetPeak(), also
+	 * between probes, e.g. temporary memory of an operation.
+	 */
+	void probePeak()
+	{
+		if (!enabled())
+			return;
+		double peak = peakUsed();
+		if (peak > m_Max)
+			m_Max = peak;
+	}
+
+	/* Account peak usage seen by a copy probed in another thread. */
+	void merge(const MemMeasurer& other)
+	{
+		if (other.m_Max > m_Max)
+			m_Max = other.m_Max;
+	}
+
+	/* Peak of bytes malloc gave out, with its rounding. */
 	double maxUsage()
 	{
 		return m_Max - m_Initial;
@@ -51,10 +106,125 @@ struct MemMeasurer {
 		return memUsed() - m_Initial;
 	}
 
+	/*
+	 * Throughput runs do not account allocations: malloc goes straight
+	 * to libc, probes do nothing and sizes are NaN. A build with
+	 * NO_MEM_MEASURE does not interpose malloc at all.
+	 */
+#ifdef NO_MEM_MEASURE
+	static constexpr bool enabled()
+	{
+		return false;
+	}
+	static void disable() {}
+#else
+	static bool enabled()
+	{
+		return s_Enabled;
+	}
+	static void disable()
+	{
+		s_Enabled = false;
+	}
+	static inline bool s_Enabled = true;
+#endif
+
+	/*
+	 * Allocations made while it lives are not accounted, e.g. of data
+	 * shared by tests. Such blocks must be freed under a Pause too.
+	 */
+	struct Pause {
+#ifdef NO_MEM_MEASURE
+		Pause() {}
+#else
+		Pause() : m_Was(s_Enabled)
+		{
+			s_Enabled = false;
+		}
+		~Pause()
+		{
+			s_Enabled = m_Was;
+		}
+		Pause(const Pause&) = delete;
+		Pause& operator=(const Pause&) = delete;
+
+		bool m_Was;
+#endif
+	};
+
 	static double memUsed();
 
 	static double countUsed();
 
+	/* High-water mark of memUsed() since resetPeak(), kept by malloc. */
+	static double peakUsed();
+	static void resetPeak();
+
+	/* All the calls since the start, NaN if not measured. */
+	static AllocCalls allocCalls();
+
+	/* Cheap and not ordered clock, allocator calls are timed with it. */
+	static uint64_t clock()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		using namespace std::chrono;
+		return steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
 	double m_Initial;
 	double m_Max;
 };
+
+/* Memory of the process as the kernel sees it, bytes, NaN if unknown. */
+struct ProcessMemory {
+	double rss = NAN;
+	double pss = NAN;
+
+	static ProcessMemory read();
+
+	/* Heap that malloc holds per byte it has given out, 1 at best. */
+	static double fragmentation();
+};
+
+/*
+ * Growth of resident memory of the process. Test data is mapped by the
+ * benchmark, not by the struct, so it is taken away, and free memory that
+ * malloc keeps after previous tests is given back before the start.
+ */
+struct ResidentMeasurer {
+	ResidentMeasurer()
+	{
+		malloc_trim(0);
+		if (!MemMeasurer::enabled())
+			return;
+		m_Initial = m_Max = ProcessMemory::read();
+		m_InitialData = data_arena_bytes();
+	}
+
+	void probe()
+	{
+		if (!MemMeasurer::enabled())
+			return;
+		ProcessMemory cur = ProcessMemory::read();
+		double data = data_arena_bytes() - m_InitialData;
+		m_Max.rss = std::fmax(m_Max.rss, cur.rss - data);
+		m_Max.pss = std::fmax(m_Max.pss, cur.pss - data);
+	}
+
+	double maxRss() const
+	{
+		return m_Max.rss - m_Initial.rss;
+	}
+
+	double maxPss() const
+	{
+		return m_Max.pss - m_Initial.pss;
+	}
+
+	ProcessMemory m_Initial;
+	ProcessMemory m_Max;
+	double m_InitialData = 0;
+};
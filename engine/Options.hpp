@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fnmatch.h>
+
+#include <DataArena.hpp>
+#include <Hash.hpp>
+#include <Workload.hpp>
+
+/* Run time settings of the benchmark, filled from the command line. */
+struct Options {
+	/* Every test is run with each of the thread counts. */
+	std::vector<size_t> threads{1};
+	/* Tests that query keys are run with each of the distributions. */
+	std::vector<QueryDist> dists{QueryDist{}};
+	/* Structs that hash keys are run with each of the hash functions. */
+	std::vector<HashKind> hashes{HASH_DEFAULT};
+	/* Pages to map test data with. */
+	DataPages pages = PAGES_4K;
+	/* Directory to keep generated test data in, none if empty. */
+	std::string data_dir;
+	/* Trace for replay tests, and file to record a test run to. */
+	std::string trace;
+	std::string record;
+	/* All threads process all the keys instead of a slice each. */
+	bool shared = false;
+	/* Pin worker threads to cores. */
+	bool pin = true;
+	/* Pin the main thread to this core, none if negative. */
+	long cpu = -1;
+	/* Account allocations of structs, off for pure throughput runs. */
+	bool mem = true;
+	/* Report median, mean, stddev and count of measured rounds. */
+	bool stats = false;
+	/* Report bucket search cost of hash functions in hash tests. */
+	bool quality = false;
+	/* Count hardware events in the measured region. */
+	bool perf = false;
+	/* Time operations in batches of this size, 0 to not time them. */
+	size_t latency = 0;
+	/*
+	 * Also measure with caches evicted before each round and, if it is
+	 * not 0, every cold_every operations.
+	 */
+	bool cold = false;
+	size_t cold_every = 0;
+	/* Glob patterns selecting tests to run, empty list selects all. */
+	std::vector<std::string> sizes;
+	std::vector<std::string> types;
+	std::vector<std::string> structs;
+	std::vector<std::string> tests;
+	std::vector<std::string> families;
+	/* Print selected tests instead of running them. */
+	bool list = false;
+	/* Run every selected test this number of times. */
+	size_t repeat = 1;
+	/* Files to write results to, none if empty. */
+	std::string json;
+	std::string csv;
+	/* Results of a previous run (JSON) to compare with. */
+	std::string baseline;
+	/* Regression that is reported, in percents. */
+	double threshold = 5;
+	/* Rounds run before measurement. */
+	size_t warmup = 1;
+	/*
+	 * Rounds are repeated until confidence interval of mean Mrps is
+	 * within ci % of it, at least min_rounds of them, unless they take
+	 * more than budget seconds.
+	 */
+	size_t min_rounds = 5;
+	double ci = 1;
+	double budget = 1;
+
+	inline bool parse(int argc, char **argv);
+	inline static void usage(const char *prog);
+	inline bool selects(size_t size, const char *type, const char *family,
+			    const char *struct_name, const char *test_name) const;
+
+private:
+	inline static bool parseList(const char *str, std::vector<size_t>& list);
+	inline static bool parseNumber(const char *arg, size_t prefix, size_t& val,
+				       size_t min = 0);
+	inline static bool parseReal(const char *arg, size_t prefix, double& val);
+	inline static void parsePatterns(const char *str,
+					 std::vector<std::string>& list);
+	inline static bool matches(const std::vector<std::string>& patterns,
+				   const char *name);
+};
+
+bool Options::parseList(const char *str, std::vector<size_t>& list)
+{
+	list.clear();
+	while (*str != 0) {
+		char *end;
+		size_t val = strtoul(str, &end, 10);
+		if (end == str || val == 0 || (*end != ',' && *end != 0))
+			return false;
+		list.push_back(val);
+		str = *end == ',' ? end + 1 : end;
+	}
+	return !list.empty();
+}
+
+bool Options::parseNumber(const char *arg, size_t prefix, size_t& val,
+			  size_t min)
+{
+	char *end;
+	val = strtoul(arg + prefix, &end, 10);
+	if (end == arg + prefix || *end != 0 || val < min) {
+		std::cerr << "Wrong number: " << arg << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Options::parseReal(const char *arg, size_t prefix, double& val)
+{
+	char *end;
+	val = strtod(arg + prefix, &end);
+	if (end == arg + prefix || *end != 0 || val < 0) {
+		std::cerr << "Wrong number: " << arg << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void Options::parsePatterns(const char *str, std::vector<std::string>& list)
+{
+	list.clear();
+	while (true) {
+		const char *end = strchrnul(str, ',');
+		list.emplace_back(str, end);
+		if (*end == 0)
+			break;
+		str = end + 1;
+	}
+}
+
+bool Options::matches(const std::vector<std::string>& patterns,
+		      const char *name)
+{
+	if (patterns.empty())
+		return true;
+	for (const std::string& pattern : patterns) {
+		if (fnmatch(pattern.c_str(), name, 0) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool Options::selects(size_t size, const char *type, const char *family,
+		      const char *struct_name, const char *test_name) const
+{
+	return matches(sizes, std::to_string(size).c_str()) &&
+	       matches(types, type) && matches(families, family) &&
+	       matches(structs, struct_name) && matches(tests, test_name);
+}
+
+bool Options::parse(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (strncmp(arg, "--threads=", 10) == 0) {
+			if (!parseList(arg + 10, threads)) {
+				std::cerr << "Wrong thread count list: " << arg << std::endl;
+				return false;
+			}
+		} else if (strncmp(arg, "--dist=", 7) == 0) {
+			std::vector<std::string> list;
+			parsePatterns(arg + 7, list);
+			dists.clear();
+			for (const std::string& str : list) {
+				QueryDist dist;
+				if (!QueryDist::parse(str, dist)) {
+					std::cerr << "Wrong distribution: " << str << std::endl;
+					return false;
+				}
+				dists.push_back(dist);
+			}
+		} else if (strncmp(arg, "--hash=", 7) == 0) {
+			std::vector<std::string> list;
+			parsePatterns(arg + 7, list);
+			hashes.clear();
+			for (const std::string& str : list) {
+				HashKind hash;
+				if (!parse_hash_kind(str, hash)) {
+					std::cerr << "Wrong hash function: " << str << std::endl;
+					return false;
+				}
+				hashes.push_back(hash);
+			}
+		} else if (strncmp(arg, "--pages=", 8) == 0) {
+			if (!parse_data_pages(arg + 8, pages)) {
+				std::cerr << "Wrong page kind: " << arg << std::endl;
+				return false;
+			}
+		} else if (strncmp(arg, "--data-dir=", 11) == 0) {
+			data_dir = arg + 11;
+		} else if (strncmp(arg, "--trace=", 8) == 0) {
+			trace = arg + 8;
+		} else if (strncmp(arg, "--record=", 9) == 0) {
+			record = arg + 9;
+		} else if (strcmp(arg, "--shared") == 0) {
+			shared = true;
+		} else if (strcmp(arg, "--no-pin") == 0) {
+			pin = false;
+		} else if (strncmp(arg, "--cpu=", 6) == 0) {
+			size_t val;
+			if (!parseNumber(arg, 6, val))
+				return false;
+			cpu = val;
+		} else if (strncmp(arg, "--warmup=", 9) == 0) {
+			if (!parseNumber(arg, 9, warmup))
+				return false;
+		} else if (strncmp(arg, "--min-rounds=", 13) == 0) {
+			if (!parseNumber(arg, 13, min_rounds, 1))
+				return false;
+		} else if (strncmp(arg, "--ci=", 5) == 0) {
+			if (!parseReal(arg, 5, ci))
+				return false;
+		} else if (strncmp(arg, "--budget=", 9) == 0) {
+			if (!parseReal(arg, 9, budget))
+				return false;
+		} else if (strcmp(arg, "--no-mem") == 0) {
+			mem = false;
+		} else if (strcmp(arg, "--stats") == 0) {
+			stats = true;
+		} else if (strcmp(arg, "--quality") == 0) {
+			quality = true;
+		} else if (strcmp(arg, "--perf") == 0) {
+			perf = true;
+		} else if (strcmp(arg, "--latency") == 0) {
+			latency = 1;
+		} else if (strncmp(arg, "--latency=", 10) == 0) {
+			if (!parseNumber(arg, 10, latency, 1))
+				return false;
+		} else if (strcmp(arg, "--cold") == 0) {
+			cold = true;
+		} else if (strncmp(arg, "--cold=", 7) == 0) {
+			cold = true;
+			if (!parseNumber(arg, 7, cold_every, 1))
+				return false;
+		} else if (strncmp(arg, "--size=", 7) == 0) {
+			parsePatterns(arg + 7, sizes);
+		} else if (strncmp(arg, "--type=", 7) == 0) {
+			parsePatterns(arg + 7, types);
+		} else if (strncmp(arg, "--struct=", 9) == 0) {
+			parsePatterns(arg + 9, structs);
+		} else if (strncmp(arg, "--test=", 7) == 0) {
+			parsePatterns(arg + 7, tests);
+		} else if (strncmp(arg, "--family=", 9) == 0) {
+			parsePatterns(arg + 9, families);
+		} else if (strcmp(arg, "--list") == 0) {
+			list = true;
+		} else if (strncmp(arg, "--json=", 7) == 0) {
+			json = arg + 7;
+		} else if (strncmp(arg, "--csv=", 6) == 0) {
+			csv = arg + 6;
+		} else if (strncmp(arg, "--compare=", 10) == 0) {
+			baseline = arg + 10;
+		} else if (strncmp(arg, "--threshold=", 12) == 0) {
+			if (!parseReal(arg, 12, threshold))
+				return false;
+		} else if (strncmp(arg, "--repeat=", 9) == 0) {
+			if (!parseNumber(arg, 9, repeat, 1))
+				return false;
+		} else {
+			if (strcmp(arg, "--help") != 0 && strcmp(arg, "-h") != 0)
+				std::cerr << "Unknown option: " << arg << std::endl;
+			usage(argv[0]);
+			return false;
+		}
+	}
+	return true;
+}
+
+void Options::usage(const char *prog)
+{
+	std::cerr << "Usage: " << prog << " [options]\n"
+		"  --threads=N[,N...]  run tests with N threads each (default 1);\n"
+		"                      structs that are not concurrent run with 1\n"
+		"  --dist=D[,D...]     run search and random workload tests with\n"
+		"                      each of query distributions (uniform):\n"
+		"                      uniform, zipf[:THETA], latest[:THETA] (both\n"
+		"                      0.99 by default), hotspot[:FRACTION[:SHARE]]\n"
+		"                      (0.2 of keys get 0.8 of queries by default)\n"
+		"  --hash=H[,H...]     run hash structs with each of hash\n"
+		"                      functions (default): default (identity\n"
+		"                      for integers, murmur3 for the rest),\n"
+		"                      murmur3, wyhash, crc32c, mult\n"
+		"  --pages=P           map test data with pages of kind P (4k):\n"
+		"                      4k, thp (transparent huge pages, madvise)\n"
+		"                      or hugetlb (the pool, thp if it is short)\n"
+		"  --data-dir=DIR      save generated test data in DIR and\n"
+		"                      read it from there in later runs\n"
+		"  --trace=FILE        run replay tests with operations of the\n"
+		"                      trace, the first SIZE of them\n"
+		"  --record=FILE       also record operations of the selected\n"
+		"                      test (just one) to a trace, in one round\n"
+		"  --shared            every thread works with all the keys\n"
+		"                      instead of its own slice of them\n"
+		"  --no-pin            do not pin worker threads to cores\n"
+		"  --cpu=N             pin the main thread (serial runs) to core N\n"
+		"  --warmup=N          unmeasured rounds before each test (1)\n"
+		"  --min-rounds=N      measure at least N rounds (5)...\n"
+		"  --ci=PCT            ...until 95% confidence interval of mean\n"
+		"                      Mrps is within PCT % of it (1)...\n"
+		"  --budget=SEC        ...or measured rounds took SEC seconds (1)\n"
+		"  --no-mem            do not measure memory, for throughput\n"
+		"                      that allocation accounting does not touch\n"
+		"  --stats             report median, mean and stddev of Mrps\n"
+		"                      of measured rounds and their count\n"
+		"  --quality           report relative cost of search in hash\n"
+		"                      buckets, measured by the hash test\n"
+		"  --perf              report hardware events per operation\n"
+		"                      (cycles, instructions, cache, TLB and\n"
+		"                      branch misses) using perf_event_open\n"
+		"  --latency[=K]       also report latency percentiles, timing\n"
+		"                      every operation or batches of K of them\n"
+		"                      in a separate pass\n"
+		"  --cold[=K]          also report Mrps with CPU caches evicted\n"
+		"                      before each round and every K operations,\n"
+		"                      in a separate pass\n"
+		"  --size=GLOB[,GLOB...]\n"
+		"  --type=GLOB[,GLOB...]\n"
+		"  --struct=GLOB[,GLOB...]\n"
+		"  --test=GLOB[,GLOB...]\n"
+		"  --family=GLOB[,GLOB...]\n"
+		"                      run only tests that match any of the\n"
+		"                      shell patterns, e.g. --struct='b+tree*'\n"
+		"  --list              print the selected tests and exit\n"
+		"  --repeat=N          run every selected test N times\n"
+		"  --json=FILE         also write results as JSON lines\n"
+		"  --csv=FILE          also write results as CSV\n"
+		"                      (both with all columns and host info)\n"
+		"  --compare=FILE      compare with results written by --json,\n"
+		"                      exit with 2 if Mrps dropped or Bytes/elem\n"
+		"                      grew more than the threshold\n"
+		"  --threshold=PCT     regression threshold, % (default 5)\n";
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+enum PerfEvent {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_EVENT_COUNT
+};
+
+struct PerfEventConfig {
+	uint32_t type;
+	uint64_t config;
+};
+
+constexpr uint64_t perf_cache_event(uint64_t id, uint64_t op, uint64_t result)
+{
+	return id | (op << 8) | (result << 16);
+}
+
+constexpr PerfEventConfig PerfEventConfigs[PERF_EVENT_COUNT] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HW_CACHE, perf_cache_event(PERF_COUNT_HW_CACHE_L1D,
+					      PERF_COUNT_HW_CACHE_OP_READ,
+					      PERF_COUNT_HW_CACHE_RESULT_MISS)},
+	{PERF_TYPE_HW_CACHE, perf_cache_event(PERF_COUNT_HW_CACHE_LL,
+					      PERF_COUNT_HW_CACHE_OP_READ,
+					      PERF_COUNT_HW_CACHE_RESULT_MISS)},
+	{PERF_TYPE_HW_CACHE, perf_cache_event(PERF_COUNT_HW_CACHE_DTLB,
+					      PERF_COUNT_HW_CACHE_OP_READ,
+					      PERF_COUNT_HW_CACHE_RESULT_MISS)},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/*
+ * Group of hardware counters of the calling thread (user space only),
+ * read all at once around a measured region and summed over regions.
+ * Events that the kernel or the CPU does not provide are just absent.
+ */
+class PerfCounters {
+public:
+	PerfCounters() = default;
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+	inline ~PerfCounters();
+
+	/* Open counters for the calling thread, false if none is available. */
+	inline bool open();
+	bool isOpen() const { return m_Leader >= 0; }
+
+	inline void start();
+	inline void stop();
+
+	/* Sum over all regions, NaN if the event is not counted. */
+	inline double total(PerfEvent event) const;
+	/* Forget what was counted so far. */
+	void reset()
+	{
+		std::fill(std::begin(m_Total), std::end(m_Total), 0);
+		m_Valid = true;
+	}
+
+private:
+	int m_Leader = -1;
+	int m_Fd[PERF_EVENT_COUNT];
+	/* Position of event in group read buffer, -1 if not opened. */
+	int m_Pos[PERF_EVENT_COUNT];
+	size_t m_Opened = 0;
+	uint64_t m_Total[PERF_EVENT_COUNT] = {};
+	bool m_Valid = true;
+};
+
+PerfCounters::~PerfCounters()
+{
+	if (m_Leader < 0)
+		return;
+	for (int i = 0; i < PERF_EVENT_COUNT; i++)
+		if (m_Pos[i] >= 0)
+			close(m_Fd[i]);
+}
+
+bool PerfCounters::open()
+{
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PerfEventConfigs[i].type;
+		attr.config = PerfEventConfigs[i].config;
+		attr.disabled = m_Leader < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP |
+				   PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+		m_Fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, m_Leader, 0);
+		m_Pos[i] = -1;
+		if (m_Fd[i] < 0)
+			continue;
+		if (m_Leader < 0)
+			m_Leader = m_Fd[i];
+		m_Pos[i] = m_Opened++;
+	}
+	return m_Leader >= 0;
+}
+
+void PerfCounters::start()
+{
+	if (m_Leader < 0)
+		return;
+	ioctl(m_Leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_Leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::stop()
+{
+	if (m_Leader < 0)
+		return;
+	ioctl(m_Leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	uint64_t buf[3 + PERF_EVENT_COUNT];
+	ssize_t len = read(m_Leader, buf, sizeof(buf));
+	/* Group that was not scheduled at all is useless. */
+	if (len < (ssize_t)((3 + m_Opened) * sizeof(uint64_t)) || buf[2] == 0) {
+		m_Valid = false;
+		return;
+	}
+	double scale = (double)buf[1] / buf[2];
+	for (int i = 0; i < PERF_EVENT_COUNT; i++)
+		if (m_Pos[i] >= 0)
+			m_Total[i] += buf[3 + m_Pos[i]] * scale;
+}
+
+double PerfCounters::total(PerfEvent event) const
+{
+	if (m_Leader < 0 || m_Pos[event] < 0 || !m_Valid)
+		return NAN;
+	return m_Total[event];
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <HostInfo.hpp>
+#include <Options.hpp>
+#include <Reporter.hpp>
+
+/* One JSON object per line: host description first, then rows. */
+class JsonSink : public ReportSink {
+public:
+	explicit JsonSink(const char *path) : m_Out(path)
+	{
+		if (!m_Out)
+			return;
+		m_Out << "{\"record\":\"host\"";
+		for (const auto& info : host_info())
+			m_Out << ",\"" << info.first << "\":" << quote(info.second);
+		m_Out << "}" << std::endl;
+	}
+
+	bool ok() const
+	{
+		return bool(m_Out);
+	}
+
+	void row(const ReportRow& row) override
+	{
+		m_Out << "{\"record\":\"row\"";
+		for (const Reporter::Column& c : Reporter::Columns) {
+			std::string value = c.value(row);
+			m_Out << ",\"" << c.key << "\":";
+			if (value == "-")
+				m_Out << "null";
+			else
+				m_Out << (c.text ? quote(value) : value);
+		}
+		m_Out << "}" << std::endl;
+	}
+
+private:
+	static std::string quote(const std::string& str)
+	{
+		std::string res = "\"";
+		for (char c : str) {
+			if (c == '"' || c == '\\') {
+				res += '\\';
+				res += c;
+			} else if ((unsigned char)c < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				res += buf;
+			} else {
+				res += c;
+			}
+		}
+		return res + "\"";
+	}
+
+	std::ofstream m_Out;
+};
+
+/* Header line and a line per row, host description in leading comments. */
+class CsvSink : public ReportSink {
+public:
+	explicit CsvSink(const char *path) : m_Out(path)
+	{
+		if (!m_Out)
+			return;
+		for (const auto& info : host_info())
+			m_Out << "# " << info.first << ": " << info.second << "\n";
+		const char *sep = "";
+		for (const Reporter::Column& c : Reporter::Columns) {
+			m_Out << sep << c.key;
+			sep = ",";
+		}
+		m_Out << std::endl;
+	}
+
+	bool ok() const
+	{
+		return bool(m_Out);
+	}
+
+	void row(const ReportRow& row) override
+	{
+		const char *sep = "";
+		for (const Reporter::Column& c : Reporter::Columns) {
+			std::string value = c.value(row);
+			m_Out << sep;
+			if (value != "-")
+				m_Out << (c.text ? quote(value) : value);
+			sep = ",";
+		}
+		m_Out << std::endl;
+	}
+
+private:
+	static std::string quote(const std::string& str)
+	{
+		std::string res = "\"";
+		for (char c : str) {
+			if (c == '"')
+				res += '"';
+			res += c;
+		}
+		return res + "\"";
+	}
+
+	std::ofstream m_Out;
+};
+
+/* Add output files and the baseline requested by the options. */
+inline bool attach_sinks(Reporter& reporter, const Options& options)
+{
+	if (!options.json.empty()) {
+		auto sink = std::make_unique<JsonSink>(options.json.c_str());
+		if (!sink->ok()) {
+			std::cerr << "Failed to open " << options.json << std::endl;
+			return false;
+		}
+		reporter.addSink(std::move(sink));
+	}
+	if (!options.csv.empty()) {
+		auto sink = std::make_unique<CsvSink>(options.csv.c_str());
+		if (!sink->ok()) {
+			std::cerr << "Failed to open " << options.csv << std::endl;
+			return false;
+		}
+		reporter.addSink(std::move(sink));
+	}
+	if (!options.baseline.empty()) {
+		Baseline baseline;
+		if (!baseline.load(options.baseline.c_str())) {
+			std::cerr << "Failed to load " << options.baseline << std::endl;
+			return false;
+		}
+		reporter.compare(std::move(baseline), options.threshold);
+	}
+	return true;
+}
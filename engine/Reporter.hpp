@@ -26,56 +26,195 @@
 
 #pragma once
 
-#include <array>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <iostream>
+#include <vector>
+
+#include <Baseline.hpp>
+#include <Latency.hpp>
+#include <PerfCounters.hpp>
+
+/* Result of one test run, a line of the report. */
+struct ReportRow {
+	size_t size;
+	const char *type;
+	const char *family;
+	const char *struct_name;
+	const char *test_name;
+	/* Distribution of queries, "-" if the test has none. */
+	const char *dist;
+	/* Hash function, "-" if the struct does not hash keys. */
+	const char *hash;
+	size_t threads;
+	/* Best of rounds and statistics of all of them. */
+	double Mrps;
+	double Mrps_median;
+	double Mrps_mean;
+	double Mrps_stddev;
+	/* Half-width of 95% confidence interval, % of mean. */
+	double Mrps_ci;
+	size_t rounds;
+	/* Difference of Mrps of threads, % of mean, NaN for one thread. */
+	double spread = NAN;
+	/* Peak of bytes malloc gave out, with its rounding, MB. */
+	double MB_use;
+	double bytes_per_record;
+	double MB_leak;
+	/* Peak growth of resident memory of the process, MB. */
+	double RSS_MB;
+	double PSS_MB;
+	/* Heap held by malloc per byte in use after the last round. */
+	double frag = NAN;
+	/* Calls to malloc and free per operation, share of time in them, %. */
+	double allocs_per_op = NAN;
+	double frees_per_op = NAN;
+	double alloc_pct = NAN;
+	size_t check;
+	/* Relative cost of search in hash buckets, NaN if not measured. */
+	double hash_quality = NAN;
+	/* Hardware events per operation, NaN if not measured. */
+	double perf[PERF_EVENT_COUNT];
+	/* Operation latency in nanoseconds, NaN if not measured. */
+	double latency[LATENCY_STAT_COUNT];
+	/* Mrps with caches evicted, NaN if not measured. */
+	double cold_Mrps = NAN;
+	/* Filled by the reporter when a baseline is given. */
+	double base_Mrps = NAN;
+	double Mrps_change = NAN;
+	double bytes_change = NAN;
+	bool regressed = false;
+};
+
+/* Receives every row with all the columns, whatever is on the screen. */
+class ReportSink {
+public:
+	virtual ~ReportSink() = default;
+	virtual void row(const ReportRow& row) = 0;
+};
 
 class Reporter {
 public:
-	Reporter() = default;
+	/* Optional groups of columns. */
+	enum {
+		PERF = 1,
+		LATENCY = 2,
+		COMPARE = 4,
+		COLD = 8,
+		THREADS = 16,
+		STATS = 32,
+		QUALITY = 64,
+	};
+
+	struct Column {
+		const char *name;
+		/* Name in machine readable output. */
+		const char *key;
+		/* Value is a string, not a number. */
+		bool text;
+		size_t width;
+		unsigned group;
+		std::string (*value)(const ReportRow& row);
+	};
+
+	explicit Reporter(unsigned groups = 0) : m_Groups(groups) {}
 	inline ~Reporter();
-	inline void report(size_t size, const char *type, const char *family,
-			   const char *struct_name, const char *test_name,
-			   double Mrps, double MB_use, double bytes_per_record,
-			   double MB_leak, size_t check);
-	void done();
+	inline void report(const ReportRow& row);
+	inline void done();
 
-private:
+	void addSink(std::unique_ptr<ReportSink> sink)
+	{
+		m_Sinks.push_back(std::move(sink));
+	}
+	/* Mark rows that are worse than the baseline by more than threshold %. */
+	void compare(Baseline baseline, double threshold)
+	{
+		m_Baseline = std::move(baseline);
+		m_Threshold = threshold;
+		m_Groups |= COMPARE;
+	}
+	size_t regressions() const
+	{
+		return m_Regressions;
+	}
 
+private:
 	static inline const char *fmt(const char *str, size_t size);
-	template <class T>
-	static inline const char *fmt(const T& num, size_t size);
+	static std::string str(const char *s) { return s; }
+	static std::string str(size_t num) { return std::to_string(num); }
+	static inline std::string str(double num, int precision);
+	static std::string str(double num) { return str(num, 6); }
 
-	void delimiter_line();
-	void intro();
-	void epilog();
+	inline void delimiter_line();
+	inline void intro();
+	inline void epilog();
+	inline void compareRow(ReportRow& row);
 
-	template <size_t col, class T, class... ARGS>
-	void line(T&& t, ARGS&&... args);
+	bool visible(const Column& c) const
+	{
+		return c.group == 0 || (c.group & m_Groups) != 0;
+	}
 
-	struct Columm {
-		const char *name;
-		size_t width;
+public:
+	static inline const Column Columns[] = {
+		{"Size", "size", false, 10, 0, [](const ReportRow& r) { return str(r.size); }},
+		{"Type", "type", true, 14, 0, [](const ReportRow& r) { return str(r.type); }},
+		{"Family", "family", true, 8, 0, [](const ReportRow& r) { return str(r.family); }},
+		{"Struct", "struct", true, 22, 0, [](const ReportRow& r) { return str(r.struct_name); }},
+		{"Test", "test", true, 21, 0, [](const ReportRow& r) { return str(r.test_name); }},
+		{"Dist", "dist", true, 15, 0, [](const ReportRow& r) { return str(r.dist); }},
+		{"Hash", "hash", true, 9, 0, [](const ReportRow& r) { return str(r.hash); }},
+		{"Threads", "threads", false, 9, 0, [](const ReportRow& r) { return str(r.threads); }},
+		{"Mrps", "mrps", false, 13, 0, [](const ReportRow& r) { return str(r.Mrps); }},
+		{"Cold Mrps", "cold_mrps", false, 13, COLD, [](const ReportRow& r) { return str(r.cold_Mrps); }},
+		{"Median", "mrps_median", false, 13, STATS, [](const ReportRow& r) { return str(r.Mrps_median); }},
+		{"Mean", "mrps_mean", false, 13, STATS, [](const ReportRow& r) { return str(r.Mrps_mean); }},
+		{"Stddev", "mrps_stddev", false, 13, STATS, [](const ReportRow& r) { return str(r.Mrps_stddev); }},
+		{"CI %", "mrps_ci_pct", false, 8, 0, [](const ReportRow& r) { return str(r.Mrps_ci, 2); }},
+		{"Rounds", "rounds", false, 8, STATS, [](const ReportRow& r) { return str(r.rounds); }},
+		{"Spread %", "spread_pct", false, 13, THREADS, [](const ReportRow& r) { return str(r.spread); }},
+		{"MB use", "mb_use", false, 13, 0, [](const ReportRow& r) { return str(r.MB_use); }},
+		{"Bytes/elem", "bytes_per_elem", false, 13, 0, [](const ReportRow& r) { return str(r.bytes_per_record); }},
+		{"MB leak", "mb_leak", false, 13, 0, [](const ReportRow& r) { return str(r.MB_leak); }},
+		{"RSS MB", "rss_mb", false, 13, 0, [](const ReportRow& r) { return str(r.RSS_MB); }},
+		{"PSS MB", "pss_mb", false, 13, 0, [](const ReportRow& r) { return str(r.PSS_MB); }},
+		{"Frag", "frag", false, 9, 0, [](const ReportRow& r) { return str(r.frag, 3); }},
+		{"Allocs/op", "allocs_per_op", false, 11, 0, [](const ReportRow& r) { return str(r.allocs_per_op, 3); }},
+		{"Frees/op", "frees_per_op", false, 11, 0, [](const ReportRow& r) { return str(r.frees_per_op, 3); }},
+		{"Alloc %", "alloc_time_pct", false, 9, 0, [](const ReportRow& r) { return str(r.alloc_pct, 2); }},
+		{"Check", "check", false, 10, 0, [](const ReportRow& r) { return str(r.check); }},
+		{"Quality", "hash_quality", false, 9, QUALITY, [](const ReportRow& r) { return str(r.hash_quality, 3); }},
+		{"Cycles/op", "cycles_per_op", false, 13, PERF, [](const ReportRow& r) { return str(r.perf[PERF_CYCLES], 2); }},
+		{"Instr/op", "instructions_per_op", false, 13, PERF, [](const ReportRow& r) { return str(r.perf[PERF_INSTRUCTIONS], 2); }},
+		{"L1D miss/op", "l1d_misses_per_op", false, 13, PERF, [](const ReportRow& r) { return str(r.perf[PERF_L1D_MISSES], 3); }},
+		{"LLC miss/op", "llc_misses_per_op", false, 13, PERF, [](const ReportRow& r) { return str(r.perf[PERF_LLC_MISSES], 3); }},
+		{"dTLB miss/op", "dtlb_misses_per_op", false, 13, PERF, [](const ReportRow& r) { return str(r.perf[PERF_DTLB_MISSES], 3); }},
+		{"Br miss/op", "branch_misses_per_op", false, 13, PERF, [](const ReportRow& r) { return str(r.perf[PERF_BRANCH_MISSES], 3); }},
+		{"p50 ns", "p50_ns", false, 11, LATENCY, [](const ReportRow& r) { return str(r.latency[LATENCY_P50], 1); }},
+		{"p90 ns", "p90_ns", false, 11, LATENCY, [](const ReportRow& r) { return str(r.latency[LATENCY_P90], 1); }},
+		{"p99 ns", "p99_ns", false, 11, LATENCY, [](const ReportRow& r) { return str(r.latency[LATENCY_P99], 1); }},
+		{"p99.9 ns", "p999_ns", false, 11, LATENCY, [](const ReportRow& r) { return str(r.latency[LATENCY_P999], 1); }},
+		{"Max ns", "max_ns", false, 11, LATENCY, [](const ReportRow& r) { return str(r.latency[LATENCY_MAX], 1); }},
+		{"Base Mrps", "base_mrps", false, 13, COMPARE, [](const ReportRow& r) { return str(r.base_Mrps); }},
+		{"Mrps diff %", "mrps_diff_pct", false, 13, COMPARE, [](const ReportRow& r) { return str(r.Mrps_change, 2); }},
+		{"B/elem diff %", "bytes_diff_pct", false, 15, COMPARE, [](const ReportRow& r) { return str(r.bytes_change, 2); }},
+		{"Regress", "regressed", true, 9, COMPARE, [](const ReportRow& r) { return str(std::isnan(r.base_Mrps) ? "-" : r.regressed ? "yes" : "no"); }},
 	};
 
-	static constexpr std::array<Columm, 10> Columns
-		{{
-			 {"Size", 10},
-			 {"Type", 14},
-			 {"Family", 8},
-			 {"Struct", 22},
-			 {"Test", 18},
-			 {"Mrps", 13},
-			 {"MB use", 13},
-			 {"Bytes/elem", 13},
-			 {"MB leak", 13},
-			 {"Check", 10}
-		 }};
+private:
 
+	unsigned m_Groups;
 	bool need_epilog = false;
+	std::vector<std::unique_ptr<ReportSink>> m_Sinks;
+	Baseline m_Baseline;
+	double m_Threshold = 0;
+	size_t m_Compared = 0;
+	size_t m_Regressions = 0;
 
 };
 
@@ -100,17 +239,21 @@ const char *Reporter::fmt(const char *str, size_t size)
 	return buf;
 }
 
-template <class T>
-const char *Reporter::fmt(const T& num, size_t size)
+std::string Reporter::str(double num, int precision)
 {
-	std::string tmp = std::to_string(num);
-	return fmt(tmp.c_str(), size);
+	if (std::isnan(num))
+		return "-";
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.*f", precision, num);
+	return buf;
 }
 
 void Reporter::delimiter_line()
 {
 	std::cout << '+';
-	for (const Columm& c: Columns) {
+	for (const Column& c: Columns) {
+		if (!visible(c))
+			continue;
 		for (size_t i = 0; i < c.width; i++)
 			std::cout << '-';
 		std::cout << '+';
@@ -123,8 +266,9 @@ void Reporter::intro()
 	delimiter_line();
 
 	std::cout << '|';
-	for (const Columm& c: Columns) {
-		std::cout << fmt(c.name, c.width) << '|';
+	for (const Column& c: Columns) {
+		if (visible(c))
+			std::cout << fmt(c.name, c.width) << '|';
 	}
 	std::cout << std::endl;
 
@@ -134,6 +278,30 @@ void Reporter::intro()
 void Reporter::epilog()
 {
 	delimiter_line();
+	if ((m_Groups & COMPARE) != 0)
+		std::cout << "Compared with baseline: " << m_Compared << " rows, "
+			  << m_Regressions << " regressed by more than "
+			  << m_Threshold << "%" << std::endl;
+}
+
+void Reporter::compareRow(ReportRow& row)
+{
+	row.base_Mrps = row.Mrps_change = row.bytes_change = NAN;
+	row.regressed = false;
+	if ((m_Groups & COMPARE) == 0)
+		return;
+	const Baseline::Entry *base = m_Baseline.find(row.size, row.type,
+		row.struct_name, row.test_name, row.dist, row.hash, row.threads);
+	if (base == nullptr)
+		return;
+	row.base_Mrps = base->Mrps;
+	row.Mrps_change = (row.Mrps - base->Mrps) / base->Mrps * 100;
+	row.bytes_change = (row.bytes_per_record - base->bytes_per_record) /
+			   base->bytes_per_record * 100;
+	row.regressed = -row.Mrps_change > m_Threshold ||
+			row.bytes_change > m_Threshold;
+	m_Compared++;
+	m_Regressions += row.regressed;
 }
 
 void Reporter::done()
@@ -149,29 +317,22 @@ Reporter::~Reporter()
 	done();
 }
 
-template <size_t col, class T, class... ARGS>
-void Reporter::line(T&& t, ARGS&&... more)
+void Reporter::report(const ReportRow& measured)
 {
-	if constexpr (col == 0)
-		std::cout << '|';
+	ReportRow row = measured;
+	compareRow(row);
 
-	std::cout << fmt(t, Columns[col].width);
-	std::cout << '|';
-	if constexpr (col + 1 < Columns.size())
-		line<col + 1>(std::forward<ARGS>(more)...);
-
-	if constexpr (col == 0)
-		std::cout << std::endl;
-}
-
-void Reporter::report(size_t size, const char *type, const char *family,
-		      const char *struct_name, const char *test_name,
-		      double Mrps, double MB_use, double bytes_per_record,
-		      double MB_leak, size_t check)
-{
 	if (!need_epilog)
 		intro();
 	need_epilog = true;
 
-	line<0>(size, type, family, struct_name, test_name, Mrps, MB_use, bytes_per_record, MB_leak, check);
+	std::cout << '|';
+	for (const Column& c: Columns) {
+		if (visible(c))
+			std::cout << fmt(c.value(row).c_str(), c.width) << '|';
+	}
+	std::cout << std::endl;
+
+	for (auto& sink : m_Sinks)
+		sink->row(row);
 }
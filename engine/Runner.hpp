@@ -28,13 +28,31 @@
 
 #include <malloc.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
 #include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <utility>
+#include <vector>
 
+#include <CacheEvictor.hpp>
+#include <Hash.hpp>
+#include <HostInfo.hpp>
+#include <Latency.hpp>
 #include <MemMeasurer.hpp>
+#include <Options.hpp>
+#include <PerfCounters.hpp>
 #include <Reporter.hpp>
+#include <Stats.hpp>
+#include <StructTraits.hpp>
+#include <Tests.hpp>
+#include <Trace.hpp>
 #include <Types.hpp>
 #include <Timer.hpp>
+#include <Workers.hpp>
 
 namespace {
 
@@ -63,6 +81,237 @@ constexpr size_t sequence_size_v = sequence_size<SEQUENCE>::value;
 
 } // anonymous namespace
 
+struct RoundResult {
+	double Mrps;
+	/* Difference between fastest and slowest thread, % of average. */
+	double spread;
+	size_t side_effect;
+};
+
+/* Runs a test by the calling thread. */
+template <class TEST>
+struct SerialRun {
+	using test_t = TEST;
+
+	/* A cold run evicts caches before the test, and as options say. */
+	SerialRun(size_t, const Options& options, bool cold = false)
+		: m_Latency(options.latency), m_Cold(cold),
+		  m_EvictEvery(cold ? options.cold_every : 0)
+	{
+		if (options.perf)
+			m_Perf.open();
+	}
+
+	RoundResult run(TEST& test, MemMeasurer& mem_measurer)
+	{
+		Timer tm;
+		LatencyRecorder::local().attach(m_Cold ? nullptr : &m_Histogram,
+						m_Latency);
+		EvictSchedule& schedule = EvictSchedule::local();
+		schedule.start(m_EvictEvery);
+		if (m_Cold)
+			cache_evictor().evict();
+		AllocCalls calls = MemMeasurer::allocCalls();
+		m_Perf.start();
+		uint64_t start = MemMeasurer::clock();
+		tm.start();
+		auto res = test.test(mem_measurer, Part{0, 1, false});
+		tm.stop();
+		tm.m_StartTime += schedule.evicted;
+		m_Ticks += MemMeasurer::clock() - start;
+		m_Perf.stop();
+		m_Alloc += MemMeasurer::allocCalls() - calls;
+		m_OpCount += res.op_count;
+		return RoundResult{tm.Mrps(res.op_count), 0, res.side_effect};
+	}
+
+	/* Allocator calls per operation and time in them, % of the rounds. */
+	void alloc(double& allocs, double& frees, double& time_pct) const
+	{
+		allocs = m_Alloc.allocs / m_OpCount;
+		frees = m_Alloc.frees / m_OpCount;
+		time_pct = m_Alloc.ticks / m_Ticks * 100;
+	}
+
+	/* Hardware events per operation over all the rounds. */
+	void perf(double (&per_op)[PERF_EVENT_COUNT]) const
+	{
+		for (int i = 0; i < PERF_EVENT_COUNT; i++)
+			per_op[i] = m_Perf.total(PerfEvent(i)) / m_OpCount;
+	}
+
+	/* Forget warmup rounds. */
+	void reset()
+	{
+		m_Perf.reset();
+		m_OpCount = 0;
+		m_Alloc = AllocCalls{};
+		m_Ticks = 0;
+		m_Histogram.clear();
+	}
+
+	/* Latencies recorded by a timed test over all the rounds. */
+	void latency(double (&ns)[LATENCY_STAT_COUNT]) const
+	{
+		latency_stats(m_Histogram, ns);
+	}
+
+	PerfCounters m_Perf;
+	size_t m_OpCount = 0;
+	AllocCalls m_Alloc;
+	double m_Ticks = 0;
+	size_t m_Latency;
+	bool m_Cold;
+	size_t m_EvictEvery;
+	Histogram m_Histogram;
+};
+
+/*
+ * Runs a test by several threads. Everything that is needed for that is
+ * allocated in advance to keep it out of memory measurement.
+ */
+template <class TEST>
+struct ParallelRun {
+	using test_t = TEST;
+
+	ParallelRun(size_t threads, const Options& options, bool cold = false)
+		: m_Workers(threads, options.pin), m_Threads(threads),
+		  m_Shared(options.shared), m_UsePerf(options.perf),
+		  m_Latency(options.latency), m_Cold(cold),
+		  m_EvictEvery(cold ? options.cold_every : 0) {}
+
+	RoundResult run(TEST& test, MemMeasurer& mem_measurer)
+	{
+		size_t count = m_Threads.size();
+		for (Thread& thread : m_Threads)
+			thread.mem_measurer = mem_measurer;
+		std::function<void(size_t)> job = [this, &test](size_t id) {
+			Thread& thread = m_Threads[id];
+			Part part{id, m_Threads.size(), m_Shared};
+			/* Counters are opened for the calling thread. */
+			if (m_UsePerf && !thread.perf_tried) {
+				thread.perf.open();
+				thread.perf_tried = true;
+			}
+			LatencyRecorder::local().attach(
+				m_Cold ? nullptr : &thread.histogram, m_Latency);
+			EvictSchedule& schedule = EvictSchedule::local();
+			schedule.start(m_EvictEvery);
+			/* Every thread has caches of its own to evict. */
+			if (m_Cold)
+				cache_evictor().evict();
+			thread.perf.start();
+			thread.timer.start();
+			thread.result = test.test(thread.mem_measurer, part);
+			thread.timer.stop();
+			thread.timer.m_StartTime += schedule.evicted;
+			thread.perf.stop();
+		};
+		AllocCalls calls = MemMeasurer::allocCalls();
+		uint64_t start = MemMeasurer::clock();
+		m_Workers.run(job);
+		/* Time of all the threads, allocator calls are made by all. */
+		m_Ticks += double(MemMeasurer::clock() - start) * count;
+		m_Alloc += MemMeasurer::allocCalls() - calls;
+
+		Timer total = m_Threads[0].timer;
+		size_t op_count = 0;
+		double min_Mrps = 0, max_Mrps = 0, sum_Mrps = 0;
+		RoundResult res{0, 0, 0};
+		for (Thread& thread : m_Threads) {
+			total.m_StartTime = std::min(total.m_StartTime,
+						     thread.timer.m_StartTime);
+			total.m_StopTime = std::max(total.m_StopTime,
+						    thread.timer.m_StopTime);
+			op_count += thread.result.op_count;
+			thread.op_count += thread.result.op_count;
+			res.side_effect += thread.result.side_effect;
+			mem_measurer.merge(thread.mem_measurer);
+
+			double Mrps = thread.timer.Mrps(thread.result.op_count);
+			min_Mrps = sum_Mrps == 0 ? Mrps : std::min(min_Mrps, Mrps);
+			max_Mrps = std::max(max_Mrps, Mrps);
+			sum_Mrps += Mrps;
+		}
+		res.Mrps = total.Mrps(op_count);
+		res.spread = (max_Mrps - min_Mrps) / (sum_Mrps / count) * 100;
+		return res;
+	}
+
+	void perf(double (&per_op)[PERF_EVENT_COUNT]) const
+	{
+		size_t op_count = 0;
+		for (const Thread& thread : m_Threads)
+			op_count += thread.op_count;
+		for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+			double total = 0;
+			for (const Thread& thread : m_Threads)
+				total += thread.perf.total(PerfEvent(i));
+			per_op[i] = total / op_count;
+		}
+	}
+
+	void alloc(double& allocs, double& frees, double& time_pct) const
+	{
+		size_t op_count = 0;
+		for (const Thread& thread : m_Threads)
+			op_count += thread.op_count;
+		allocs = m_Alloc.allocs / op_count;
+		frees = m_Alloc.frees / op_count;
+		time_pct = m_Alloc.ticks / m_Ticks * 100;
+	}
+
+	void reset()
+	{
+		for (Thread& thread : m_Threads) {
+			thread.perf.reset();
+			thread.op_count = 0;
+			thread.histogram.clear();
+		}
+		m_Alloc = AllocCalls{};
+		m_Ticks = 0;
+	}
+
+	void latency(double (&ns)[LATENCY_STAT_COUNT]) const
+	{
+		Histogram total;
+		for (const Thread& thread : m_Threads)
+			total.merge(thread.histogram);
+		latency_stats(total, ns);
+	}
+
+	struct Thread {
+		Timer timer;
+		TestResult result;
+		MemMeasurer mem_measurer;
+		PerfCounters perf;
+		bool perf_tried = false;
+		size_t op_count = 0;
+		Histogram histogram;
+	};
+
+	Workers m_Workers;
+	std::vector<Thread> m_Threads;
+	AllocCalls m_Alloc;
+	double m_Ticks = 0;
+	bool m_Shared;
+	bool m_UsePerf;
+	size_t m_Latency;
+	bool m_Cold;
+	size_t m_EvictEvery;
+};
+
+/* One cell of the test matrix, selectable at run time. */
+struct TestCell {
+	size_t size;
+	const char *type;
+	const char *family;
+	const char *struct_name;
+	const char *test_name;
+	/* Runs the test with all the thread counts, returns number of runs. */
+	size_t (*run)(Reporter& reporter, const Options& options);
+};
+
 template <class SIZES, class TYPES, template <typename TYPE> class STRUCTS,
 	template <size_t SIZE, typename TYPE, typename STRUCT> class TESTS>
 struct AllTests {
@@ -99,50 +348,223 @@ struct AllTests {
 		using type_t = std::tuple_element_t<TYPE_I, TYPES>;
 		using struct_t = std::tuple_element_t<STRUCT_I, STRUCTS<type_t>>;
 		using test_t = std::tuple_element_t<TEST_I, TESTS<size, type_t, struct_t>>;
+		/* The same test with every operation timed. */
+		using latency_test_t = std::tuple_element_t<TEST_I,
+			TESTS<size, type_t, LatencyStruct<type_t, struct_t>>>;
+		/* The same test with every operation logged. */
+		using record_test_t = std::tuple_element_t<TEST_I,
+			TESTS<size, type_t, RecordingStruct<type_t, struct_t>>>;
 	};
 
 	template <class ONE_TEST>
-	static size_t run_one(Reporter& reporter)
+	static size_t run_one(Reporter& reporter, const Options& options,
+			      size_t threads, const QueryDist& dist)
+	{
+		using struct_t = typename ONE_TEST::struct_t;
+
+		if constexpr (struct_is_concurrent_v<struct_t>) {
+			if (threads > 1) {
+				reporter.report(run_with<ONE_TEST, ParallelRun>(
+					options, threads, dist));
+				return 1;
+			}
+		}
+		reporter.report(run_with<ONE_TEST, SerialRun>(options, threads, dist));
+		return 1;
+	}
+
+	/*
+	 * Throughput is measured first, latencies, if requested, in a separate
+	 * pass so that timing does not affect the throughput, and so is cold
+	 * throughput. It runs the same test as the warm pass, test loops
+	 * evict caches every K operations, see TestProgress.
+	 */
+	template <class ONE_TEST, template <class> class RUN>
+	static ReportRow run_with(const Options& options, size_t threads,
+				  const QueryDist& dist)
+	{
+		RUN<typename ONE_TEST::test_t> run(threads, options);
+		ReportRow row = measure<ONE_TEST>(run, options, threads, dist);
+		if (options.latency) {
+			RUN<typename ONE_TEST::latency_test_t> timed(threads, options);
+			measure<ONE_TEST>(timed, options, threads, dist);
+			timed.latency(row.latency);
+		}
+		if (options.cold) {
+			RUN<typename ONE_TEST::test_t> cold(threads, options, true);
+			row.cold_Mrps = measure<ONE_TEST>(cold, options, threads,
+							  dist).Mrps;
+		}
+		if (!options.record.empty())
+			record<ONE_TEST, RUN>(options, threads, dist);
+		return row;
+	}
+
+	/*
+	 * One round of the test with the struct wrapped to log operations,
+	 * the whole life of the struct is in the trace.
+	 */
+	template <class ONE_TEST, template <class> class RUN>
+	static void record(const Options& options, size_t threads,
+			   const QueryDist& dist)
+	{
+		using test_t = typename ONE_TEST::record_test_t;
+
+		RUN<test_t> run(threads, options);
+		TraceWriter writer;
+		trace_writer() = &writer;
+		{
+			test_t test = make_test<test_t>(dist);
+			MemMeasurer mem_measurer;
+			test.prepare();
+			run.run(test, mem_measurer);
+			test.cleanup();
+		}
+		trace_writer() = nullptr;
+		if (writer.save(options.record))
+			std::cout << "Recorded " << writer.count()
+				  << " operations to " << options.record
+				  << std::endl;
+		else
+			std::cout << "Failed to save " << options.record
+				  << std::endl;
+	}
+
+	template <class ONE_TEST, class RUN>
+	static ReportRow measure(RUN& run, const Options& options,
+				 size_t threads, const QueryDist& dist)
 	{
 		constexpr size_t size = ONE_TEST::size;
 		using type_t = typename ONE_TEST::type_t;
 		using struct_t = typename ONE_TEST::struct_t;
-		using test_t = typename ONE_TEST::test_t;
+		using test_t = typename RUN::test_t;
 
+		RoundStats stats;
 		MemMeasurer mem_measurer;
+		ResidentMeasurer resident;
 		double bestMrps = 0;
+		double spread = 0;
 		size_t side_effect = 0;
+		double quality = NAN;
+		double frag = NAN;
 		{
-			test_t test;
-			size_t rounds = 256 * 1024 / size;
-			rounds = rounds ? rounds : 1;
-			for (size_t i = 0; i < rounds; i++) {
+			test_t test = make_test<test_t>(dist);
+			auto round = [&]() {
 				test.prepare();
-				Timer tm;
 				mem_measurer.probe();
-				tm.start();
-				auto res = test.test(mem_measurer);
-				tm.stop();
+				RoundResult res = run.run(test, mem_measurer);
 				mem_measurer.probe();
+				resident.probe();
+				/* The last round leaves it, before cleanup. */
+				if (MemMeasurer::enabled())
+					frag = ProcessMemory::fragmentation();
 				test.cleanup();
-				bestMrps = std::max(bestMrps,
-						    tm.Mrps(res.op_count));
+				return res;
+			};
+			for (size_t i = 0; i < options.warmup; i++)
+				round();
+			run.reset();
+
+			Timer budget;
+			budget.start();
+			while (!stats.full()) {
+				RoundResult res = round();
+				stats.add(res.Mrps);
+				if (res.Mrps > bestMrps) {
+					bestMrps = res.Mrps;
+					spread = res.spread;
+				}
 				side_effect = res.side_effect;
+
+				budget.stop();
+				if (budget.get() >= options.budget)
+					break;
+				if (stats.count() >= options.min_rounds &&
+				    stats.ci() <= options.ci)
+					break;
 			}
+			/* Not in the latency pass, it would be timed. */
+			if constexpr (test_has_quality_v<test_t> &&
+				      std::is_same_v<test_t, typename ONE_TEST::test_t>)
+				quality = test.quality();
 		}
 		double MB_used = mem_measurer.maxUsage() / 1024 / 1024;
 		double bytes_per_record = mem_measurer.maxUsage() / size;
 		double MB_leak = mem_measurer.leak() / 1024 / 1024;
 
-		reporter.report(size, TypeTraits<type_t>::name, struct_t::family,
-				struct_t::name, test_t::name,
-				bestMrps, MB_used, bytes_per_record, MB_leak, side_effect);
+		ReportRow row;
+		row.size = size;
+		row.type = TypeTraits<type_t>::name;
+		row.family = struct_t::family;
+		row.struct_name = struct_t::name;
+		row.test_name = test_t::name;
+		row.dist = test_uses_dist_v<test_t> ? dist.label.c_str() : "-";
+		row.hash = struct_is_hashed_v<struct_t, type_t> ?
+			   hash_kind_names[current_hash()] : "-";
+		row.threads = threads;
+		row.Mrps = bestMrps;
+		row.Mrps_median = stats.median();
+		row.Mrps_mean = stats.mean();
+		row.Mrps_stddev = stats.stddev();
+		row.Mrps_ci = stats.ci();
+		row.rounds = stats.count();
+		if (threads > 1)
+			row.spread = spread;
+		row.MB_use = MB_used;
+		row.bytes_per_record = bytes_per_record;
+		row.MB_leak = MB_leak;
+		row.RSS_MB = resident.maxRss() / 1024 / 1024;
+		row.PSS_MB = resident.maxPss() / 1024 / 1024;
+		row.frag = frag;
+		row.check = side_effect;
+		row.hash_quality = quality;
+		run.perf(row.perf);
+		run.alloc(row.allocs_per_op, row.frees_per_op, row.alloc_pct);
+		std::fill(std::begin(row.latency), std::end(row.latency), NAN);
 
-		return 1;
+		return row;
 	}
 
 	template <class ONE_TEST>
-	static size_t run_one_check(Reporter& reporter)
+	static size_t run_dists(Reporter& reporter, const Options& options,
+				size_t threads)
+	{
+		using test_t = typename ONE_TEST::test_t;
+
+		if (!test_uses_dist_v<test_t>)
+			return run_one<ONE_TEST>(reporter, options, threads, QueryDist{});
+		size_t count = 0;
+		for (const QueryDist& dist : options.dists)
+			count += run_one<ONE_TEST>(reporter, options, threads, dist);
+		return count;
+	}
+
+	/* Hash structs are run with each of the hash functions. */
+	template <class ONE_TEST>
+	static size_t run_threads(Reporter& reporter, const Options& options)
+	{
+		using type_t = typename ONE_TEST::type_t;
+		using struct_t = typename ONE_TEST::struct_t;
+
+		size_t count = 0;
+		for (size_t threads : options.threads) {
+			if (threads > 1 && !struct_is_concurrent_v<struct_t>)
+				continue;
+			if (!struct_is_hashed_v<struct_t, type_t>) {
+				count += run_dists<ONE_TEST>(reporter, options, threads);
+				continue;
+			}
+			for (HashKind hash : options.hashes) {
+				current_hash() = hash;
+				count += run_dists<ONE_TEST>(reporter, options, threads);
+			}
+			current_hash() = HASH_DEFAULT;
+		}
+		return count;
+	}
+
+	template <class ONE_TEST>
+	static TestCell make_cell()
 	{
 		constexpr size_t size = ONE_TEST::size;
 		using type_t = typename ONE_TEST::type_t;
@@ -152,22 +574,113 @@ struct AllTests {
 		if constexpr (size == 0 ||
 			std::is_same_v<type_t, nullptr_t> ||
 			std::is_same_v<struct_t, nullptr_t> ||
-			std::is_same_v<test_t, nullptr_t>) {
-			return 0;
+			std::is_same_v<test_t, nullptr_t> ||
+			!test_is_used_v<test_t>) {
+			return TestCell{0, nullptr, nullptr, nullptr, nullptr, nullptr};
+		} else if constexpr (!struct_t::use) {
+			return TestCell{0, nullptr, nullptr, nullptr, nullptr, nullptr};
 		} else {
-			return run_one<ONE_TEST>(reporter);
+			return TestCell{size, TypeTraits<type_t>::name,
+					struct_t::family, struct_t::name,
+					test_t::name, &run_threads<ONE_TEST>};
 		}
 	}
 
 	template <size_t... IDX>
-	static size_t run_all_impl(Reporter& reporter, std::index_sequence<IDX...>)
+	static std::vector<TestCell> make_cells(std::index_sequence<IDX...>)
 	{
-		return ((run_one_check<OneTest<IDX>>(reporter))+...);
+		std::vector<TestCell> cells;
+		for (const TestCell& cell : {make_cell<OneTest<IDX>>()...}) {
+			if (cell.run != nullptr)
+				cells.push_back(cell);
+		}
+		return cells;
 	}
 
-	static size_t run_all()
+	/* All the valid cells of the matrix. */
+	static const std::vector<TestCell>& cells()
 	{
-		Reporter reporter;
-		return run_all_impl(reporter, std::make_index_sequence<size()>{});
+		static const std::vector<TestCell> all =
+			make_cells(std::make_index_sequence<size()>{});
+		return all;
 	}
 };
+
+/* Run the selected cells in the given order, return number of runs. */
+inline size_t run_cells(const std::vector<TestCell>& cells,
+			const Options& options, Reporter& reporter)
+{
+	if (!options.trace.empty() && !replay_trace().load(options.trace)) {
+		std::cerr << "Failed to read trace " << options.trace << std::endl;
+		return 0;
+	}
+	/*
+	 * Replay runs only with a trace, and with sizes up to the first
+	 * one that takes all of it.
+	 */
+	size_t replay_count = replay_trace().count();
+	size_t replay_max = 0;
+	for (const TestCell& cell : cells) {
+		if (cell.size >= replay_count &&
+		    (replay_max == 0 || cell.size < replay_max))
+			replay_max = cell.size;
+	}
+
+	std::vector<TestCell> selected;
+	for (const TestCell& cell : cells) {
+		if (strcmp(cell.test_name, replay_test_name) == 0 &&
+		    (options.trace.empty() || cell.size > replay_max))
+			continue;
+		if (options.selects(cell.size, cell.type, cell.family,
+				    cell.struct_name, cell.test_name))
+			selected.push_back(cell);
+	}
+	if (!options.record.empty() &&
+	    (selected.size() != 1 || options.threads.size() != 1 ||
+	     options.dists.size() != 1 || options.hashes.size() != 1)) {
+		std::cerr << "Only one test run can be recorded" << std::endl;
+		return 0;
+	}
+
+	if (options.list) {
+		for (const TestCell& cell : selected)
+			std::cout << cell.size << '\t' << cell.type << '\t'
+				  << cell.family << '\t' << cell.struct_name
+				  << '\t' << cell.test_name << std::endl;
+		return 0;
+	}
+
+	if (options.perf && !PerfCounters().open())
+		std::cout << "Hardware counters are not available: "
+			  << strerror(errno) << std::endl;
+	if (options.latency)
+		Tsc::calibrate();
+	if (options.cpu >= 0 && !pin_to_cpu(pthread_self(), options.cpu))
+		std::cout << "Failed to pin to CPU " << options.cpu << std::endl;
+	std::string governor = cpu_governor();
+	if (governor != "performance" && governor != "unknown")
+		std::cout << "CPU frequency governor is " << governor
+			  << ", results may vary; consider 'performance'"
+			  << std::endl;
+	dataset_cache().setDir(options.data_dir);
+	if (options.pages != PAGES_4K)
+		std::cout << "Test data is mapped with " << data_pages_report()
+			  << " pages" << std::endl;
+	if (!MemMeasurer::enabled())
+		std::cout << "Memory is not measured" << std::endl;
+	if (options.cold) {
+		std::cout << "Caches are evicted with a "
+			  << (cache_evictor().size() >> 20) << " MB buffer "
+			  << "before each round";
+		if (options.cold_every != 0)
+			std::cout << " and every " << options.cold_every
+				  << " operations";
+		std::cout << std::endl;
+	}
+	size_t count = 0;
+	for (const TestCell& cell : selected) {
+		for (size_t i = 0; i < options.repeat; i++)
+			count += cell.run(reporter, options);
+	}
+	return count;
+}
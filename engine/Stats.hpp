@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/*
+ * Statistics of per-round results. Samples are kept in place so that
+ * nothing is allocated while memory of a test is being measured.
+ */
+class RoundStats {
+public:
+	static constexpr size_t MAX_ROUNDS = 4096;
+
+	void add(double value)
+	{
+		if (m_Count < MAX_ROUNDS)
+			m_Samples[m_Count++] = value;
+	}
+	bool full() const
+	{
+		return m_Count == MAX_ROUNDS;
+	}
+	size_t count() const
+	{
+		return m_Count;
+	}
+	double best() const
+	{
+		return m_Count == 0 ? NAN : *std::max_element(m_Samples, m_Samples + m_Count);
+	}
+	double mean() const
+	{
+		if (m_Count == 0)
+			return NAN;
+		double sum = 0;
+		for (size_t i = 0; i < m_Count; i++)
+			sum += m_Samples[i];
+		return sum / m_Count;
+	}
+	double median() const
+	{
+		if (m_Count == 0)
+			return NAN;
+		double sorted[MAX_ROUNDS];
+		std::copy(m_Samples, m_Samples + m_Count, sorted);
+		std::sort(sorted, sorted + m_Count);
+		size_t mid = m_Count / 2;
+		return m_Count % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+	}
+	/* Sample standard deviation. */
+	double stddev() const
+	{
+		if (m_Count < 2)
+			return NAN;
+		double avg = mean(), sum = 0;
+		for (size_t i = 0; i < m_Count; i++)
+			sum += (m_Samples[i] - avg) * (m_Samples[i] - avg);
+		return std::sqrt(sum / (m_Count - 1));
+	}
+	/* Half-width of 95% confidence interval of the mean, % of the mean. */
+	double ci() const
+	{
+		if (m_Count < 2)
+			return NAN;
+		return student(m_Count - 1) * stddev() / std::sqrt(m_Count) /
+		       mean() * 100;
+	}
+
+private:
+	/* Two-sided 95% quantile of Student's t-distribution. */
+	static double student(size_t freedom)
+	{
+		static constexpr double t[] = {
+			12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+			2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+			2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+			2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+		};
+		constexpr size_t size = sizeof(t) / sizeof(t[0]);
+		return freedom <= size ? t[freedom - 1] : 1.96;
+	}
+
+	double m_Samples[MAX_ROUNDS];
+	size_t m_Count = 0;
+};
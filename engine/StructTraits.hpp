@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Optional parts of the struct concept. Besides mandatory insert, remove,
+ * has, clear, size, family, name and use a struct may declare:
+ *  concurrent - all operations may be called from several threads.
+ *  has_batch(const TYPE *keys, size_t count, bool *res) - look up several
+ *   keys at once, e.g. overlapping their cache misses.
+ *  insert_batch(const TYPE *keys, size_t count, bool *res) - the same for
+ *   insertion.
+ *  bulk_load(const TYPE *first, const TYPE *last, bool sorted) - insert
+ *   many keys at once, possibly repeated ones, ascending if sorted.
+ *  lower_bound(const TYPE& t, TYPE& res) - find the least key not less
+ *   than t, return false if there is none.
+ *  scan(const TYPE& from, size_t k, F&& f) - call f(key) for up to k
+ *   least keys not less than from in ascending order, return the count.
+ *  static hash(const TYPE& t) - hash the struct applies to keys, see
+ *   struct_is_hashed. Such structs are run with every requested hash.
+ * Use struct_has_batch, struct_insert_batch and struct_bulk_load to call
+ * the operations on many keys, they fall back to a loop if the struct
+ * does not have them. Ordered operations go together and have no
+ * fallback, see struct_is_ordered.
+ */
+template <class STRUCT, class = void>
+struct struct_is_concurrent : std::false_type {};
+
+template <class STRUCT>
+struct struct_is_concurrent<STRUCT, std::void_t<decltype(STRUCT::concurrent)>>
+	: std::bool_constant<STRUCT::concurrent> {};
+
+template <class STRUCT>
+constexpr bool struct_is_concurrent_v = struct_is_concurrent<STRUCT>::value;
+
+template <class STRUCT, typename TYPE, class = void>
+struct struct_is_ordered : std::false_type {};
+
+template <class STRUCT, typename TYPE>
+struct struct_is_ordered<STRUCT, TYPE, std::void_t<decltype(
+	std::declval<const STRUCT&>().lower_bound(std::declval<const TYPE&>(),
+						  std::declval<TYPE&>()))>>
+	: std::true_type {};
+
+template <class STRUCT, typename TYPE>
+constexpr bool struct_is_ordered_v = struct_is_ordered<STRUCT, TYPE>::value;
+
+template <class STRUCT, typename TYPE, class = void>
+struct struct_is_hashed : std::false_type {};
+
+template <class STRUCT, typename TYPE>
+struct struct_is_hashed<STRUCT, TYPE, std::void_t<decltype(
+	STRUCT::hash(std::declval<const TYPE&>()))>>
+	: std::true_type {};
+
+template <class STRUCT, typename TYPE>
+constexpr bool struct_is_hashed_v = struct_is_hashed<STRUCT, TYPE>::value;
+
+template <class STRUCT, class = void>
+struct struct_has_has_batch : std::false_type {};
+
+template <class STRUCT>
+struct struct_has_has_batch<STRUCT, std::void_t<decltype(&STRUCT::has_batch)>>
+	: std::true_type {};
+
+template <class STRUCT, class = void>
+struct struct_has_insert_batch : std::false_type {};
+
+template <class STRUCT>
+struct struct_has_insert_batch<STRUCT, std::void_t<decltype(&STRUCT::insert_batch)>>
+	: std::true_type {};
+
+template <class STRUCT, class = void>
+struct struct_has_bulk_load : std::false_type {};
+
+template <class STRUCT>
+struct struct_has_bulk_load<STRUCT, std::void_t<decltype(&STRUCT::bulk_load)>>
+	: std::true_type {};
+
+template <class STRUCT, typename TYPE>
+void struct_has_batch(const STRUCT& s, const TYPE *keys, size_t count, bool *res)
+{
+	if constexpr (struct_has_has_batch<STRUCT>::value) {
+		s.has_batch(keys, count, res);
+	} else {
+		for (size_t i = 0; i < count; i++)
+			res[i] = s.has(keys[i]);
+	}
+}
+
+template <class STRUCT, typename TYPE>
+void struct_insert_batch(STRUCT& s, const TYPE *keys, size_t count, bool *res)
+{
+	if constexpr (struct_has_insert_batch<STRUCT>::value) {
+		s.insert_batch(keys, count, res);
+	} else {
+		for (size_t i = 0; i < count; i++)
+			res[i] = s.insert(keys[i]);
+	}
+}
+
+template <class STRUCT, typename TYPE>
+void struct_bulk_load(STRUCT& s, const TYPE *first, const TYPE *last, bool sorted)
+{
+	if constexpr (struct_has_bulk_load<STRUCT>::value) {
+		s.bulk_load(first, last, sorted);
+	} else {
+		(void)sorted;
+		for (; first != last; ++first)
+			s.insert(*first);
+	}
+}
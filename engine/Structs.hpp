@@ -25,11 +25,25 @@
  */
 
 #pragma once
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
+#include <type_traits>
 #include <unordered_set>
 
-template <typename TYPE>
+#include <Allocators.hpp>
+#include <StructTraits.hpp>
+#include <Types.hpp>
+
+template <typename TYPE, class ALLOC = std::allocator<TYPE>>
 struct StdSetStruct {
+	using allocator_type = ALLOC;
+
+	StdSetStruct() = default;
+	explicit StdSetStruct(const ALLOC& alloc) : m_Core(alloc) {}
+
 	bool insert(const TYPE& t)
 	{
 		return m_Core.insert(t).second;
@@ -42,6 +56,33 @@ struct StdSetStruct {
 	{
 		return m_Core.find(t) != m_Core.end();
 	}
+	/* Sorted keys go to the end, the hint makes it amortized constant. */
+	void bulk_load(const TYPE *first, const TYPE *last, bool sorted)
+	{
+		if (!sorted) {
+			m_Core.insert(first, last);
+			return;
+		}
+		for (; first != last; ++first)
+			m_Core.insert(m_Core.end(), *first);
+	}
+	bool lower_bound(const TYPE& t, TYPE& res) const
+	{
+		auto itr = m_Core.lower_bound(t);
+		if (itr == m_Core.end())
+			return false;
+		res = *itr;
+		return true;
+	}
+	template <class F>
+	size_t scan(const TYPE& from, size_t k, F&& f) const
+	{
+		size_t n = 0;
+		for (auto itr = m_Core.lower_bound(from);
+		     n < k && itr != m_Core.end(); ++itr, ++n)
+			f(*itr);
+		return n;
+	}
 	void clear()
 	{
 		m_Core.clear();
@@ -54,11 +95,16 @@ struct StdSetStruct {
 	static constexpr const char *name = "std::set";
 	static constexpr bool use = true;
 
-	std::set<TYPE> m_Core;
+	std::set<TYPE, std::less<TYPE>, ALLOC> m_Core;
 };
 
-template <typename TYPE>
+template <typename TYPE, class ALLOC = std::allocator<TYPE>>
 struct StdUnorderedSetStruct {
+	using allocator_type = ALLOC;
+
+	StdUnorderedSetStruct() = default;
+	explicit StdUnorderedSetStruct(const ALLOC& alloc) : m_Core(alloc) {}
+
 	bool insert(const TYPE& t)
 	{
 		return m_Core.insert(t).second;
@@ -71,6 +117,16 @@ struct StdUnorderedSetStruct {
 	{
 		return m_Core.find(t) != m_Core.end();
 	}
+	static uint64_t hash(const TYPE& t)
+	{
+		return TypeHash<TYPE>()(t);
+	}
+	/* Buckets are allocated once instead of growing with inserts. */
+	void bulk_load(const TYPE *first, const TYPE *last, bool)
+	{
+		m_Core.reserve(m_Core.size() + (last - first));
+		m_Core.insert(first, last);
+	}
 	void clear()
 	{
 		m_Core.clear();
@@ -83,5 +139,182 @@ struct StdUnorderedSetStruct {
 	static constexpr const char *name = "std::unordered_set";
 	static constexpr bool use = true;
 
-	std::unordered_set<TYPE> m_Core;
+	std::unordered_set<TYPE, TypeHash<TYPE>, std::equal_to<TYPE>, ALLOC> m_Core;
+};
+
+/* Any struct made usable from several threads by a readers-writer lock. */
+template <typename TYPE, class STRUCT>
+struct SharedMutexStruct {
+	bool insert(const TYPE& t)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Core.insert(t);
+	}
+	bool remove(const TYPE& t)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Core.remove(t);
+	}
+	bool has(const TYPE& t) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Core.has(t);
+	}
+	/* The lock is taken once for the whole batch. */
+	void has_batch(const TYPE *keys, size_t count, bool *res) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		struct_has_batch(m_Core, keys, count, res);
+	}
+	void insert_batch(const TYPE *keys, size_t count, bool *res)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		struct_insert_batch(m_Core, keys, count, res);
+	}
+	void bulk_load(const TYPE *first, const TYPE *last, bool sorted)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		struct_bulk_load(m_Core, first, last, sorted);
+	}
+	/* Ordered operations are there only if STRUCT has them. */
+	template <class S = STRUCT, class = std::enable_if_t<struct_is_ordered_v<S, TYPE>>>
+	bool lower_bound(const TYPE& t, TYPE& res) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Core.lower_bound(t, res);
+	}
+	template <class F, class S = STRUCT, class = std::enable_if_t<struct_is_ordered_v<S, TYPE>>>
+	size_t scan(const TYPE& from, size_t k, F&& f) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Core.scan(from, k, std::forward<F>(f));
+	}
+	template <class S = STRUCT, class = std::enable_if_t<struct_is_hashed_v<S, TYPE>>>
+	static uint64_t hash(const TYPE& t)
+	{
+		return S::hash(t);
+	}
+	void clear()
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		m_Core.clear();
+	}
+	size_t size() const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Core.size();
+	}
+	static constexpr const char *family = STRUCT::family;
+	static constexpr bool use = true;
+	static constexpr bool concurrent = true;
+
+	mutable std::shared_mutex m_Mutex;
+	STRUCT m_Core;
+};
+
+template <typename TYPE>
+struct LockedStdSetStruct : SharedMutexStruct<TYPE, StdSetStruct<TYPE>> {
+	static constexpr const char *name = "locked std::set";
+};
+
+template <typename TYPE>
+struct LockedStdUnorderedSetStruct
+	: SharedMutexStruct<TYPE, StdUnorderedSetStruct<TYPE>> {
+	static constexpr const char *name = "locked unordered_set";
+};
+
+/* Resource is a base that goes first, so it outlives the container. */
+template <class RESOURCE>
+struct ResourceHolder {
+	RESOURCE m_Resource;
+};
+
+/* STRUCT of a std container that allocates from RESOURCE of its own. */
+template <class STRUCT, class RESOURCE>
+struct WithResource : ResourceHolder<RESOURCE>, STRUCT {
+	WithResource()
+		: STRUCT(typename STRUCT::allocator_type(&this->m_Resource)) {}
+	/*
+	 * Monotonic resources take memory back only all at once, and a
+	 * cleared unordered_set keeps its buckets, so the container is
+	 * swapped with an empty one before the resource is released.
+	 */
+	void clear()
+	{
+		using Core = decltype(STRUCT::m_Core);
+		Core(this->m_Core.get_allocator()).swap(this->m_Core);
+		this->m_Resource.release();
+	}
+};
+
+template <typename TYPE>
+using PmrAllocator = std::pmr::polymorphic_allocator<TYPE>;
+
+template <typename TYPE>
+struct SlabStdSetStruct
+	: WithResource<StdSetStruct<TYPE, SlabAllocator<TYPE>>, SlabHeap> {
+	static constexpr const char *name = "std::set slab";
+};
+
+template <typename TYPE>
+struct ArenaStdSetStruct
+	: WithResource<StdSetStruct<TYPE, ArenaAllocator<TYPE>>, MonotonicArena> {
+	static constexpr const char *name = "std::set arena";
+};
+
+template <typename TYPE>
+struct PmrPoolStdSetStruct
+	: WithResource<StdSetStruct<TYPE, PmrAllocator<TYPE>>,
+		       PmrPoolResource> {
+	static constexpr const char *name = "std::set pmr pool";
+};
+
+template <typename TYPE>
+struct PmrMonoStdSetStruct
+	: WithResource<StdSetStruct<TYPE, PmrAllocator<TYPE>>,
+		       PmrMonotonicResource> {
+	static constexpr const char *name = "std::set pmr mono";
+};
+
+template <typename TYPE>
+struct SlabStdUnorderedSetStruct
+	: WithResource<StdUnorderedSetStruct<TYPE, SlabAllocator<TYPE>>, SlabHeap> {
+	static constexpr const char *name = "unordered_set slab";
+};
+
+template <typename TYPE>
+struct ArenaStdUnorderedSetStruct
+	: WithResource<StdUnorderedSetStruct<TYPE, ArenaAllocator<TYPE>>,
+		       MonotonicArena> {
+	static constexpr const char *name = "unordered_set arena";
+};
+
+template <typename TYPE>
+struct PmrPoolStdUnorderedSetStruct
+	: WithResource<StdUnorderedSetStruct<TYPE, PmrAllocator<TYPE>>,
+		       PmrPoolResource> {
+	static constexpr const char *name = "unordered_set pmr pool";
+};
+
+template <typename TYPE>
+struct PmrMonoStdUnorderedSetStruct
+	: WithResource<StdUnorderedSetStruct<TYPE, PmrAllocator<TYPE>>,
+		       PmrMonotonicResource> {
+	static constexpr const char *name = "unordered_set pmr mono";
+};
+
+/*
+ * Not a set: the hash that std containers and their locked and allocator
+ * variants apply to keys, for the hash test to be run once per type and
+ * hash instead of once for each of them.
+ */
+template <typename TYPE>
+struct KeyHashStruct {
+	static uint64_t hash(const TYPE& t)
+	{
+		return TypeHash<TYPE>()(t);
+	}
+	static constexpr const char *family = "hash";
+	static constexpr const char *name = "key hash";
+	static constexpr bool use = true;
 };
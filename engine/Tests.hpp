@@ -28,39 +28,182 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <random>
+#include <type_traits>
+#include <vector>
 
+#include <CacheEvictor.hpp>
+#include <Dataset.hpp>
 #include <MemMeasurer.hpp>
+#include <StructTraits.hpp>
+#include <Trace.hpp>
 #include <Types.hpp>
+#include <Workload.hpp>
+
+/* Number of keys passed at once to batched operations. */
+static constexpr size_t TEST_BATCH = 32;
 
 struct TestResult {
 	size_t op_count;
 	size_t side_effect;
 };
 
+/*
+ * Range of the test data processed by one of several threads running
+ * the same test: a slice of it, or all of it if keys are shared.
+ */
+struct Part {
+	size_t id;
+	size_t count;
+	bool shared;
+
+	size_t begin(size_t from, size_t to) const
+	{
+		return shared ? from : from + (to - from) * id / count;
+	}
+	size_t end(size_t from, size_t to) const
+	{
+		return shared ? to : from + (to - from) * (id + 1) / count;
+	}
+	bool whole() const
+	{
+		return count == 1;
+	}
+};
+
+/*
+ * Progress of a test loop, it is told of every operation: memory is
+ * probed every PROBE_EVERY of them and, in cold runs, caches are evicted
+ * as EvictSchedule of the thread says. A countdown to the next of them
+ * is all the loop pays for, warm or cold.
+ */
+class TestProgress {
+public:
+	static constexpr size_t PROBE_EVERY = 1024;
+
+	explicit TestProgress(MemMeasurer& mem_measurer)
+		: m_MemMeasurer(mem_measurer),
+		  m_Schedule(EvictSchedule::local()),
+		  m_ToEvict(m_Schedule.every)
+	{
+		m_MemMeasurer.probe();
+		m_Left = m_Step = next();
+	}
+
+	/* Called after @count operations. */
+	void done(size_t count = 1)
+	{
+		if (count < m_Left)
+			m_Left -= count;
+		else
+			step(m_Step - m_Left + count);
+	}
+
+private:
+	size_t next() const
+	{
+		return m_Schedule.every == 0 ? m_ToProbe :
+		       std::min(m_ToProbe, m_ToEvict);
+	}
+
+	void step(size_t passed) __attribute_noinline__
+	{
+		m_ToProbe = m_ToProbe > passed ? m_ToProbe - passed : 0;
+		if (m_ToProbe == 0) {
+			m_MemMeasurer.probe();
+			m_ToProbe = PROBE_EVERY;
+		}
+		if (m_Schedule.every != 0) {
+			m_ToEvict = m_ToEvict > passed ? m_ToEvict - passed : 0;
+			if (m_ToEvict == 0) {
+				m_Schedule.evicted += cache_evictor().evict();
+				m_ToEvict = m_Schedule.every;
+			}
+		}
+		m_Left = m_Step = next();
+	}
+
+	MemMeasurer& m_MemMeasurer;
+	EvictSchedule& m_Schedule;
+	size_t m_ToProbe = PROBE_EVERY;
+	size_t m_ToEvict;
+	size_t m_Step;
+	size_t m_Left;
+};
+
 template <typename TYPE>
 struct TestBase {
 	TestBase() = default;
 
+	/* Tests may reorder keys, so they take a copy of the shared set. */
 	template <size_t COUNT, size_t MAX>
 	void genData()
 	{
-		srand(0);
-		static_assert(COUNT * sizeof(TYPE) <= MAX_DATA_SIZE, "increase buffer");
 		m_DataSize = COUNT;
-		for (size_t i = 0; i < m_DataSize; i++)
-			m_Data[i] = TypeTraits<TYPE>::gen(MAX);
-		std::random_shuffle(m_Data, m_Data + m_DataSize);
+		m_Data = (TYPE *)m_Arena.get(COUNT * sizeof(TYPE));
+		const TYPE *keys = dataset_cache().get<TYPE>(COUNT, MAX);
+		memcpy((void *)m_Data, keys, COUNT * sizeof(TYPE));
 	}
 
-	~TestBase()
+	/*
+	 * Keys to query at [from, to): the data itself for uniform queries,
+	 * otherwise keys of the same range drawn by the distribution.
+	 */
+	void genQueries(const QueryDist& dist, size_t from, size_t to)
 	{
-		TypeTraits<TYPE>::free_gen();
+		if (dist.kind == QueryDist::UNIFORM) {
+			m_Queries = m_Data;
+			return;
+		}
+		m_Queries = m_Stream.get(to, from);
+		QueryGenerator gen(dist, to - from);
+		for (size_t i = from; i < to; i++)
+			m_Queries[i] = m_Data[from + gen()];
 	}
 
-	TYPE*& m_Data = TypeTraits<TYPE>::data();
+	DataArena m_Arena;
+	TYPE *m_Data = nullptr;
 	size_t m_DataSize = 0;
+	TYPE *m_Queries = nullptr;
+	MappedArray<TYPE> m_Stream;
 };
 
+/* Tests that measure quality of hashing report it with quality(). */
+template <class TEST, class = void>
+struct test_has_quality : std::false_type {};
+
+template <class TEST>
+struct test_has_quality<TEST, std::void_t<decltype(std::declval<const TEST&>().quality())>>
+	: std::true_type {};
+
+template <class TEST>
+constexpr bool test_has_quality_v = test_has_quality<TEST>::value;
+
+/* Tests that take a QueryDist are run with each of requested ones. */
+template <class TEST>
+constexpr bool test_uses_dist_v = std::is_constructible_v<TEST, const QueryDist&>;
+
+template <class TEST>
+TEST make_test(const QueryDist& dist)
+{
+	if constexpr (test_uses_dist_v<TEST>)
+		return TEST(dist);
+	else
+		return TEST();
+}
+
+/* Tests declare use = false for structs they do not apply to. */
+template <class TEST, class = void>
+struct test_is_used : std::true_type {};
+
+template <class TEST>
+struct test_is_used<TEST, std::void_t<decltype(TEST::use)>>
+	: std::bool_constant<TEST::use> {};
+
+template <class TEST>
+constexpr bool test_is_used_v = test_is_used<TEST>::value;
+
 template <size_t SIZE, typename TYPE, class STRUCT>
 struct Insert : TestBase<TYPE> {
 	Insert()
@@ -77,16 +220,17 @@ struct Insert : TestBase<TYPE> {
 		assert(m_Set.size() == 0);
 	}
 
-	TestResult test(MemMeasurer& mem_measurer) __attribute_noinline__
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
 	{
 		size_t inserted = 0;
-		for (size_t i = 0; i < SIZE; i++) {
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
 			inserted += m_Set.insert(this->m_Data[i]);
-			if (i % 1024 == 0)
-				mem_measurer.probe();
+			progress.done();
 		}
-		assert(inserted == m_Set.size());
-		return TestResult{SIZE, inserted};
+		assert(!part.whole() || inserted == m_Set.size());
+		return TestResult{end - begin, inserted};
 	}
 
 	void cleanup()
@@ -98,6 +242,78 @@ struct Insert : TestBase<TYPE> {
 	static constexpr const char *name = "insert";
 };
 
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct InsertBatched : Insert<SIZE, TYPE, STRUCT> {
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		bool res[TEST_BATCH];
+		size_t inserted = 0;
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i += TEST_BATCH) {
+			size_t n = std::min(TEST_BATCH, end - i);
+			struct_insert_batch(this->m_Set, this->m_Data + i, n, res);
+			for (size_t j = 0; j < n; j++)
+				inserted += res[j];
+			progress.done(n);
+		}
+		assert(!part.whole() || inserted == this->m_Set.size());
+		return TestResult{end - begin, inserted};
+	}
+
+	static constexpr const char *name = "insert batched";
+};
+
+/*
+ * Build of a set from all the keys at once, in random or ascending order.
+ * Keys are sorted ahead of time, sorting is not a part of the build.
+ */
+template <bool SORTED>
+struct BulkLoad {
+	template <size_t SIZE, typename TYPE, class STRUCT>
+	struct Test : TestBase<TYPE> {
+		Test()
+		{
+			this->template genData<SIZE, SIZE * 10>();
+			if (SORTED)
+				std::sort(this->m_Data, this->m_Data + SIZE,
+					  [](const TYPE& a, const TYPE& b) {
+						  return TypeTraits<TYPE>::cmp(a, b) < 0;
+					  });
+		}
+		~Test()
+		{
+			assert(m_Set.size() == 0);
+		}
+
+		void prepare()
+		{
+			assert(m_Set.size() == 0);
+		}
+
+		TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+		{
+			size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+			/* Buffers of the load are freed by its end. */
+			MemMeasurer::resetPeak();
+			struct_bulk_load(m_Set, this->m_Data + begin,
+					 this->m_Data + end, SORTED);
+			mem_measurer.probePeak();
+			/* Set size is reported once however many threads run. */
+			return TestResult{end - begin, part.id == 0 ? m_Set.size() : 0};
+		}
+
+		void cleanup()
+		{
+			m_Set.clear();
+		}
+
+		STRUCT m_Set;
+		static constexpr const char *name =
+			SORTED ? "bulk load sorted" : "bulk load";
+	};
+};
+
 template <size_t SIZE, typename TYPE, class STRUCT>
 struct Delete : TestBase<TYPE> {
 	Delete()
@@ -117,17 +333,18 @@ struct Delete : TestBase<TYPE> {
 			m_Set.insert(this->m_Data[i]);
 	}
 
-	TestResult test(MemMeasurer& mem_measurer) __attribute_noinline__
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
 	{
 		size_t deteted = 0;
 		size_t was_size = m_Set.size();
-		for (size_t i = 0; i < SIZE; i++) {
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
 			deteted += m_Set.remove(this->m_Data[i]);
-			if (i % 1024 == 0)
-				mem_measurer.probe();
+			progress.done();
 		}
-		assert(deteted == was_size); (void)was_size;
-		return TestResult{SIZE, deteted};
+		assert(!part.whole() || deteted == was_size); (void)was_size;
+		return TestResult{end - begin, deteted};
 	}
 
 	void cleanup()
@@ -141,11 +358,12 @@ struct Delete : TestBase<TYPE> {
 
 template <size_t SIZE, typename TYPE, class STRUCT>
 struct SearchHit : TestBase<TYPE> {
-	SearchHit()
+	explicit SearchHit(const QueryDist& dist)
 	{
 		this->template genData<SIZE, SIZE * 10>();
 		for (size_t i = 0; i < SIZE; i++)
 			m_Set.insert(this->m_Data[i]);
+		this->genQueries(dist, 0, SIZE);
 	}
 
 	~SearchHit()
@@ -157,16 +375,17 @@ struct SearchHit : TestBase<TYPE> {
 	{
 	}
 
-	TestResult test(MemMeasurer& mem_measurer) __attribute_noinline__
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
 	{
 		size_t res = 0;
-		for (size_t i = 0; i < SIZE; i++) {
-			res += m_Set.has(this->m_Data[i]);
-			if (i % 1024 == 0)
-				mem_measurer.probe();
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			res += m_Set.has(this->m_Queries[i]);
+			progress.done();
 		}
-		assert(res == SIZE);
-		return TestResult{SIZE, res};
+		assert(res == end - begin);
+		return TestResult{end - begin, res};
 	}
 
 	void cleanup()
@@ -177,13 +396,38 @@ struct SearchHit : TestBase<TYPE> {
 	static constexpr const char *name = "search hit";
 };
 
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct SearchHitBatched : SearchHit<SIZE, TYPE, STRUCT> {
+	using SearchHit<SIZE, TYPE, STRUCT>::SearchHit;
+
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		bool found[TEST_BATCH];
+		size_t res = 0;
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i += TEST_BATCH) {
+			size_t n = std::min(TEST_BATCH, end - i);
+			struct_has_batch(this->m_Set, this->m_Queries + i, n, found);
+			for (size_t j = 0; j < n; j++)
+				res += found[j];
+			progress.done(n);
+		}
+		assert(res == end - begin);
+		return TestResult{end - begin, res};
+	}
+
+	static constexpr const char *name = "search hit batched";
+};
+
 template <size_t SIZE, typename TYPE, class STRUCT>
 struct SearchMiss : TestBase<TYPE> {
-	SearchMiss()
+	explicit SearchMiss(const QueryDist& dist)
 	{
 		this->template genData<SIZE * 2, SIZE * 10>();
 		for (size_t i = 0; i < SIZE; i++)
 			m_Set.insert(this->m_Data[i]);
+		this->genQueries(dist, SIZE, SIZE * 2);
 	}
 
 	~SearchMiss()
@@ -195,15 +439,16 @@ struct SearchMiss : TestBase<TYPE> {
 	{
 	}
 
-	TestResult test(MemMeasurer& mem_measurer) __attribute_noinline__
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
 	{
 		size_t res = 0;
-		for (size_t i = SIZE; i < SIZE * 2; i++) {
-			res += m_Set.has(this->m_Data[i]);
-			if (i % 1024 == 0)
-				mem_measurer.probe();
+		size_t begin = part.begin(SIZE, SIZE * 2), end = part.end(SIZE, SIZE * 2);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			res += m_Set.has(this->m_Queries[i]);
+			progress.done();
 		}
-		return TestResult{SIZE, res};
+		return TestResult{end - begin, res};
 	}
 
 	void cleanup()
@@ -214,13 +459,37 @@ struct SearchMiss : TestBase<TYPE> {
 	static constexpr const char *name = "search miss";
 };
 
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct SearchMissBatched : SearchMiss<SIZE, TYPE, STRUCT> {
+	using SearchMiss<SIZE, TYPE, STRUCT>::SearchMiss;
+
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		bool found[TEST_BATCH];
+		size_t res = 0;
+		size_t begin = part.begin(SIZE, SIZE * 2), end = part.end(SIZE, SIZE * 2);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i += TEST_BATCH) {
+			size_t n = std::min(TEST_BATCH, end - i);
+			struct_has_batch(this->m_Set, this->m_Queries + i, n, found);
+			for (size_t j = 0; j < n; j++)
+				res += found[j];
+			progress.done(n);
+		}
+		return TestResult{end - begin, res};
+	}
+
+	static constexpr const char *name = "search miss batched";
+};
+
 template <size_t SIZE, typename TYPE, class STRUCT>
 struct SearchMixed : TestBase<TYPE> {
-	SearchMixed()
+	explicit SearchMixed(const QueryDist& dist)
 	{
 		this->template genData<SIZE * 2, SIZE * 10>();
 		for (size_t i = 0; i < this->m_DataSize; i += 2)
 			m_Set.insert(this->m_Data[i]);
+		this->genQueries(dist, 0, this->m_DataSize);
 	}
 
 	~SearchMixed()
@@ -232,15 +501,17 @@ struct SearchMixed : TestBase<TYPE> {
 	{
 	}
 
-	TestResult test(MemMeasurer& mem_measurer) __attribute_noinline__
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
 	{
 		size_t res = 0;
-		for (size_t i = 0; i < this->m_DataSize; i++) {
-			res += m_Set.has(this->m_Data[i]);
-			if (i % 1024 == 0)
-				mem_measurer.probe();
+		size_t begin = part.begin(0, this->m_DataSize);
+		size_t end = part.end(0, this->m_DataSize);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			res += m_Set.has(this->m_Queries[i]);
+			progress.done();
 		}
-		return TestResult{this->m_DataSize, res};
+		return TestResult{end - begin, res};
 	}
 
 	void cleanup()
@@ -251,12 +522,116 @@ struct SearchMixed : TestBase<TYPE> {
 	static constexpr const char *name = "search mixed";
 };
 
+/* Least key not less than a query, a half of queries are not in the set. */
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct Successor : TestBase<TYPE> {
+	explicit Successor(const QueryDist& dist)
+	{
+		this->template genData<SIZE * 2, SIZE * 10>();
+		for (size_t i = 0; i < this->m_DataSize; i += 2)
+			m_Set.insert(this->m_Data[i]);
+		this->genQueries(dist, 0, this->m_DataSize);
+	}
+
+	~Successor()
+	{
+		m_Set.clear();
+	}
+
+	void prepare()
+	{
+	}
+
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		size_t res = 0;
+		size_t begin = part.begin(0, this->m_DataSize);
+		size_t end = part.end(0, this->m_DataSize);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			TYPE next{};
+			if (m_Set.lower_bound(this->m_Queries[i], next))
+				res += TypeTraits<TYPE>::equals(next, this->m_Queries[i]) + 1;
+			progress.done();
+		}
+		return TestResult{end - begin, res};
+	}
+
+	void cleanup()
+	{
+	}
+
+	STRUCT m_Set;
+	static constexpr const char *name = "successor";
+	static constexpr bool use = struct_is_ordered_v<STRUCT, TYPE>;
+};
+
+inline constexpr const char *range_scan_name(size_t length)
+{
+	return length == 10 ? "range scan 10" :
+	       length == 100 ? "range scan 100" : "range scan";
+}
+
+/*
+ * Up to LENGTH keys from a query on, copied out, an operation is a whole
+ * scan. There are fewer scans for longer ones so that a round visits
+ * about the same number of keys.
+ */
+template <size_t LENGTH>
+struct RangeScan {
+	template <size_t SIZE, typename TYPE, class STRUCT>
+	struct Test : TestBase<TYPE> {
+		static constexpr size_t COUNT = std::max<size_t>(SIZE * 2 / LENGTH, 1024);
+
+		explicit Test(const QueryDist& dist)
+		{
+			this->template genData<SIZE * 2, SIZE * 10>();
+			for (size_t i = 0; i < this->m_DataSize; i += 2)
+				m_Set.insert(this->m_Data[i]);
+			this->genQueries(dist, 0, this->m_DataSize);
+		}
+
+		~Test()
+		{
+			m_Set.clear();
+		}
+
+		void prepare()
+		{
+		}
+
+		TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+		{
+			TYPE keys[LENGTH];
+			size_t res = 0;
+			size_t begin = part.begin(0, COUNT), end = part.end(0, COUNT);
+			TestProgress progress(mem_measurer);
+			for (size_t i = begin; i < end; i++) {
+				size_t n = 0;
+				m_Set.scan(this->m_Queries[i], LENGTH,
+					   [&](const TYPE& t) { keys[n++] = t; });
+				res += n;
+				progress.done();
+			}
+			return TestResult{end - begin, res};
+		}
+
+		void cleanup()
+		{
+		}
+
+		STRUCT m_Set;
+		static constexpr const char *name = range_scan_name(LENGTH);
+		static constexpr bool use = struct_is_ordered_v<STRUCT, TYPE>;
+	};
+};
 
 template <size_t SIZE, typename TYPE, class STRUCT>
 struct RandWorkload : TestBase<TYPE> {
-	RandWorkload()
+	explicit RandWorkload(const QueryDist& dist)
 	{
 		this->template genData<SIZE * 4, SIZE * 2>();
+		this->genQueries(dist, SIZE, this->m_DataSize);
 	}
 
 	~RandWorkload()
@@ -270,17 +645,20 @@ struct RandWorkload : TestBase<TYPE> {
 			m_Set.insert(this->m_Data[i]);
 	}
 
-	TestResult test(MemMeasurer& mem_measurer) __attribute_noinline__
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
 	{
-		for (size_t i = SIZE; i < this->m_DataSize; i++) {
-			if (m_Set.has(this->m_Data[i]))
-				m_Set.remove(this->m_Data[i]);
+		size_t begin = part.begin(SIZE, this->m_DataSize);
+		size_t end = part.end(SIZE, this->m_DataSize);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			if (m_Set.has(this->m_Queries[i]))
+				m_Set.remove(this->m_Queries[i]);
 			else
-				m_Set.insert(this->m_Data[i]);
-			if (i % 1024 == 0)
-				mem_measurer.probe();
+				m_Set.insert(this->m_Queries[i]);
+			progress.done();
 		}
-		return TestResult{this->m_DataSize - SIZE, m_Set.size()};
+		/* Set size is reported once however many threads run. */
+		return TestResult{end - begin, part.id == 0 ? m_Set.size() : 0};
 	}
 
 	void cleanup()
@@ -291,3 +669,281 @@ struct RandWorkload : TestBase<TYPE> {
 	STRUCT m_Set;
 	static constexpr const char *name = "rand workload";
 };
+
+/*
+ * Operations of a mix, generated ahead of time: a set of SIZE keys is
+ * simulated to pick existing keys to read, update and delete using the
+ * distribution over insertion order, and fresh keys to insert.
+ */
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct MixedWorkload : TestBase<TYPE> {
+	MixedWorkload(const QueryDist& dist, const OpMix& mix)
+	{
+		this->template genData<SIZE * 2, SIZE * 10>();
+		m_Ops = m_OpArray.get(SIZE);
+		m_Keys = m_KeyArray.get(SIZE);
+
+		LiveKeys live(SIZE * 2, SIZE);
+		QueryGenerator gen(dist, SIZE);
+		std::mt19937_64 rng(SIZE);
+		for (size_t i = 0; i < SIZE; i++) {
+			unsigned r = rng() % 100;
+			unsigned op = 0;
+			while (op < OP_COUNT - 1 && r >= mix.share[op])
+				r -= mix.share[op++];
+			if (live.size() == 0)
+				op = OP_INSERT;
+			m_Ops[i] = Op(op);
+			if (op == OP_INSERT) {
+				m_Keys[i] = this->m_Data[live.insert()];
+				continue;
+			}
+			size_t key = live[gen(live.size())];
+			m_Keys[i] = this->m_Data[key];
+			if (op == OP_DELETE)
+				live.remove(key);
+		}
+	}
+
+	~MixedWorkload()
+	{
+		assert(m_Set.size() == 0);
+	}
+
+	void prepare()
+	{
+		for (size_t i = 0; i < SIZE; i++)
+			m_Set.insert(this->m_Data[i]);
+	}
+
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		size_t res = 0;
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			const TYPE& key = m_Keys[i];
+			switch (m_Ops[i]) {
+			case OP_READ:
+				res += m_Set.has(key);
+				break;
+			case OP_SCAN:
+				res += scan(key, 1 + i % MAX_SCAN);
+				break;
+			case OP_UPDATE:
+				res += m_Set.remove(key) && m_Set.insert(key);
+				break;
+			case OP_INSERT:
+				res += m_Set.insert(key);
+				break;
+			case OP_DELETE:
+				res += m_Set.remove(key);
+				break;
+			case OP_RMW:
+				if (m_Set.has(key))
+					res += m_Set.remove(key) && m_Set.insert(key);
+				break;
+			default:
+				break;
+			}
+			progress.done();
+		}
+		return TestResult{end - begin, res};
+	}
+
+	void cleanup()
+	{
+		m_Set.clear();
+	}
+
+	/* Scan lengths go round 1..MAX_SCAN, as uniform ones of YCSB E. */
+	static constexpr size_t MAX_SCAN = 100;
+
+	size_t scan(const TYPE& from, size_t length)
+	{
+		if constexpr (struct_is_ordered_v<STRUCT, TYPE>) {
+			TYPE keys[MAX_SCAN];
+			size_t n = 0;
+			m_Set.scan(from, length, [&](const TYPE& t) { keys[n++] = t; });
+			return n;
+		} else {
+			(void)from; (void)length;
+			return 0;
+		}
+	}
+
+	STRUCT m_Set;
+	Op *m_Ops;
+	TYPE *m_Keys;
+	MappedArray<Op> m_OpArray;
+	MappedArray<TYPE> m_KeyArray;
+};
+
+/* Mixed workload with shares of operations from MIX (see Workload.hpp). */
+template <class MIX>
+struct Mixed {
+	template <size_t SIZE, typename TYPE, class STRUCT>
+	struct Test : MixedWorkload<SIZE, TYPE, STRUCT> {
+		explicit Test(const QueryDist& dist)
+			: MixedWorkload<SIZE, TYPE, STRUCT>(dist, MIX::mix) {}
+
+		static constexpr const char *name = MIX::name;
+		static constexpr bool use = MIX::mix.share[OP_SCAN] == 0 ||
+			struct_is_ordered_v<STRUCT, TYPE>;
+	};
+};
+
+/*
+ * Hashing of keys the way a hash struct does it, without the struct, the
+ * matrix runs it with KeyHashStruct only. Quality is the cost of a search
+ * in SIZE buckets chosen by low bits of the hash, relative to that of an
+ * ideal random hash: 1 is as good as random, more is worse.
+ */
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct Hashing : TestBase<TYPE> {
+	Hashing()
+	{
+		this->template genData<SIZE, SIZE * 10>();
+	}
+
+	void prepare()
+	{
+	}
+
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		size_t res = 0;
+		size_t begin = part.begin(0, SIZE), end = part.end(0, SIZE);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			res += STRUCT::hash(this->m_Data[i]) & 1;
+			progress.done();
+		}
+		return TestResult{end - begin, res};
+	}
+
+	void cleanup()
+	{
+	}
+
+	/* Repeated keys are counted once, as a set would keep them. */
+	double quality() const
+	{
+		static_assert((SIZE & (SIZE - 1)) == 0, "buckets are chosen by bits");
+		std::vector<TYPE> keys(this->m_Data, this->m_Data + SIZE);
+		auto less = [](const TYPE& a, const TYPE& b) {
+			return TypeTraits<TYPE>::cmp(a, b) < 0;
+		};
+		auto equals = [](const TYPE& a, const TYPE& b) {
+			return TypeTraits<TYPE>::equals(a, b);
+		};
+		std::sort(keys.begin(), keys.end(), less);
+		keys.erase(std::unique(keys.begin(), keys.end(), equals), keys.end());
+		std::vector<uint32_t> buckets(SIZE);
+		double cost = 0;
+		for (const TYPE& t : keys)
+			cost += ++buckets[STRUCT::hash(t) & (SIZE - 1)];
+		double n = keys.size(), m = SIZE;
+		return cost / (n / (2 * m) * (n + 2 * m - 1));
+	}
+
+	static constexpr const char *name = "hash";
+	static constexpr bool use = struct_is_hashed_v<STRUCT, TYPE>;
+};
+
+static constexpr const char *replay_test_name = "replay";
+
+/*
+ * Replay of the first SIZE operations of replay_trace(), all of them if
+ * there are fewer. Keys are made of numbers of the trace before rounds.
+ * Structs that are not ordered read the key instead of a scan. Several
+ * threads replay a slice of the trace each.
+ */
+template <size_t SIZE, typename TYPE, class STRUCT>
+struct Replay : TestBase<TYPE> {
+	Replay()
+	{
+		const Trace& trace = replay_trace();
+		m_Count = std::min(SIZE, trace.count());
+		m_Codes = trace.codes();
+		this->m_DataSize = m_Count;
+		this->m_Data = (TYPE *)this->m_Arena.get(
+			std::max<size_t>(m_Count, 1) * sizeof(TYPE));
+		char *strings = nullptr;
+		if (TypeTraits<TYPE>::STRING_SIZE != 0)
+			strings = m_Strings.get(std::max<size_t>(m_Count, 1) *
+						TypeTraits<TYPE>::STRING_SIZE);
+		char *first = strings;
+		for (size_t i = 0; i < m_Count; i++)
+			this->m_Data[i] = TypeTraits<TYPE>::gen(trace.keys()[i],
+								strings);
+		m_Strings.trim(strings - first);
+	}
+
+	~Replay()
+	{
+		assert(m_Set.size() == 0);
+	}
+
+	void prepare()
+	{
+		assert(m_Set.size() == 0);
+	}
+
+	TestResult test(MemMeasurer& mem_measurer, const Part& part) __attribute_noinline__
+	{
+		size_t res = 0;
+		size_t begin = part.begin(0, m_Count), end = part.end(0, m_Count);
+		TestProgress progress(mem_measurer);
+		for (size_t i = begin; i < end; i++) {
+			const TYPE& key = this->m_Data[i];
+			switch (trace_op(m_Codes[i])) {
+			case OP_READ:
+				res += m_Set.has(key);
+				break;
+			case OP_SCAN:
+				res += scan(key, trace_scan(m_Codes[i]));
+				break;
+			case OP_UPDATE:
+				res += m_Set.remove(key) && m_Set.insert(key);
+				break;
+			case OP_INSERT:
+				res += m_Set.insert(key);
+				break;
+			case OP_DELETE:
+				res += m_Set.remove(key);
+				break;
+			case OP_RMW:
+				if (m_Set.has(key))
+					res += m_Set.remove(key) && m_Set.insert(key);
+				break;
+			default:
+				break;
+			}
+			progress.done();
+		}
+		return TestResult{end - begin, res};
+	}
+
+	void cleanup()
+	{
+		m_Set.clear();
+	}
+
+	size_t scan(const TYPE& from, size_t length)
+	{
+		if constexpr (struct_is_ordered_v<STRUCT, TYPE>) {
+			TYPE last;
+			return m_Set.scan(from, length, [&](const TYPE& t) { last = t; });
+		} else {
+			(void)length;
+			return m_Set.has(from);
+		}
+	}
+
+	STRUCT m_Set;
+	size_t m_Count;
+	const uint16_t *m_Codes;
+	DataArena m_Strings;
+	static constexpr const char *name = replay_test_name;
+};
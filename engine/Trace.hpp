@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <StructTraits.hpp>
+#include <Types.hpp>
+#include <Workload.hpp>
+
+/*
+ * Trace of operations on a set, the file is:
+ *  Header,
+ *  uint16_t code[count] - Op in low TRACE_OP_BITS, above is the length
+ *   of a scan, 0 for other operations,
+ *  zero padding to 8 bytes,
+ *  uint64_t key[count].
+ * Keys are numbers that keys of any type are made of (TypeTraits::gen):
+ * uint64_t keys are kept as they are, other ones by their 64-bit wyhash,
+ * whatever hash the run uses. Equal keys stay equal, different ones
+ * collide with odds of 10^-5 for 16M keys, but their order is not kept.
+ */
+static constexpr unsigned TRACE_OP_BITS = 4;
+static constexpr size_t TRACE_MAX_SCAN = (1 << (16 - TRACE_OP_BITS)) - 1;
+
+inline uint16_t trace_code(Op op, size_t scan = 0)
+{
+	return op | std::min(scan, TRACE_MAX_SCAN) << TRACE_OP_BITS;
+}
+
+inline Op trace_op(uint16_t code)
+{
+	return Op(code & ((1 << TRACE_OP_BITS) - 1));
+}
+
+inline size_t trace_scan(uint16_t code)
+{
+	return code >> TRACE_OP_BITS;
+}
+
+template <typename TYPE>
+uint64_t trace_key(const TYPE& t)
+{
+	if constexpr (std::is_same_v<TYPE, uint64_t>)
+		return t;
+	else
+		return TypeTraits<TYPE>::hash(t, HASH_WYHASH);
+}
+
+struct TraceHeader {
+	char magic[8];
+	uint64_t version;
+	uint64_t count;
+};
+
+static constexpr char TRACE_MAGIC[8] = "DSTRACE";
+static constexpr uint64_t TRACE_VERSION = 1;
+
+inline size_t trace_keys_offset(size_t count)
+{
+	return (sizeof(TraceHeader) + count * sizeof(uint16_t) + 7) / 8 * 8;
+}
+
+/* A trace file mapped to memory. */
+class Trace {
+public:
+	Trace() = default;
+	Trace(const Trace&) = delete;
+	Trace& operator=(const Trace&) = delete;
+	~Trace()
+	{
+		unload();
+	}
+
+	bool load(const std::string& path)
+	{
+		unload();
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+			close(fd);
+			return false;
+		}
+		m_Size = st.st_size;
+		m_Mem = mmap(nullptr, m_Size, PROT_READ,
+			     MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		close(fd);
+		if (m_Mem == MAP_FAILED) {
+			m_Mem = nullptr;
+			return false;
+		}
+		TraceHeader h;
+		memcpy(&h, m_Mem, sizeof(h));
+		size_t keys = trace_keys_offset(h.count);
+		if (memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0 ||
+		    h.version != TRACE_VERSION ||
+		    m_Size != keys + h.count * sizeof(uint64_t)) {
+			unload();
+			return false;
+		}
+		m_Count = h.count;
+		m_Codes = (const uint16_t *)((const char *)m_Mem + sizeof(h));
+		m_Keys = (const uint64_t *)((const char *)m_Mem + keys);
+		return true;
+	}
+
+	size_t count() const
+	{
+		return m_Count;
+	}
+	const uint16_t *codes() const
+	{
+		return m_Codes;
+	}
+	const uint64_t *keys() const
+	{
+		return m_Keys;
+	}
+
+private:
+	void unload()
+	{
+		if (m_Mem != nullptr)
+			munmap(m_Mem, m_Size);
+		m_Mem = nullptr;
+		m_Size = 0;
+		m_Count = 0;
+		m_Codes = nullptr;
+		m_Keys = nullptr;
+	}
+
+	void *m_Mem = nullptr;
+	size_t m_Size = 0;
+	size_t m_Count = 0;
+	const uint16_t *m_Codes = nullptr;
+	const uint64_t *m_Keys = nullptr;
+};
+
+/* The trace that replay tests run, loaded before them. */
+inline Trace& replay_trace()
+{
+	static Trace trace;
+	return trace;
+}
+
+/* Operations logged in memory and saved as a trace. */
+class TraceWriter {
+public:
+	void add(Op op, uint64_t key, size_t scan = 0)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Codes.push_back(trace_code(op, scan));
+		m_Keys.push_back(key);
+	}
+
+	size_t count() const
+	{
+		return m_Codes.size();
+	}
+
+	/* Written aside and renamed, so a file is either complete or absent. */
+	bool save(const std::string& path) const
+	{
+		std::string tmp = path + ".tmp";
+		TraceHeader h;
+		memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+		h.version = TRACE_VERSION;
+		h.count = m_Codes.size();
+		static const char zeros[8] = {};
+		size_t pad = trace_keys_offset(h.count) - sizeof(h) -
+			     h.count * sizeof(uint16_t);
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		out.write((const char *)&h, sizeof(h));
+		out.write((const char *)m_Codes.data(), h.count * sizeof(uint16_t));
+		out.write(zeros, pad);
+		out.write((const char *)m_Keys.data(), h.count * sizeof(uint64_t));
+		out.close();
+		if (!out || rename(tmp.c_str(), path.c_str()) != 0) {
+			remove(tmp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::mutex m_Mutex;
+	std::vector<uint16_t> m_Codes;
+	std::vector<uint64_t> m_Keys;
+};
+
+/* Where RecordingStruct logs operations, nowhere if null. */
+inline TraceWriter *&trace_writer()
+{
+	static TraceWriter *writer;
+	return writer;
+}
+
+/*
+ * Struct wrapper that logs operations to trace_writer() if it is set.
+ * Batches are logged key by key, bulk load as inserts and lower_bound as
+ * a scan of one key.
+ */
+template <typename TYPE, class STRUCT>
+struct RecordingStruct {
+	bool insert(const TYPE& t)
+	{
+		record(OP_INSERT, t);
+		return m_Core.insert(t);
+	}
+	bool remove(const TYPE& t)
+	{
+		record(OP_DELETE, t);
+		return m_Core.remove(t);
+	}
+	bool has(const TYPE& t) const
+	{
+		record(OP_READ, t);
+		return m_Core.has(t);
+	}
+	void has_batch(const TYPE *keys, size_t count, bool *res) const
+	{
+		for (size_t i = 0; i < count; i++)
+			record(OP_READ, keys[i]);
+		struct_has_batch(m_Core, keys, count, res);
+	}
+	void insert_batch(const TYPE *keys, size_t count, bool *res)
+	{
+		for (size_t i = 0; i < count; i++)
+			record(OP_INSERT, keys[i]);
+		struct_insert_batch(m_Core, keys, count, res);
+	}
+	void bulk_load(const TYPE *first, const TYPE *last, bool sorted)
+	{
+		for (const TYPE *t = first; t != last; ++t)
+			record(OP_INSERT, *t);
+		struct_bulk_load(m_Core, first, last, sorted);
+	}
+	template <class S = STRUCT, class = std::enable_if_t<struct_is_ordered_v<S, TYPE>>>
+	bool lower_bound(const TYPE& t, TYPE& res) const
+	{
+		record(OP_SCAN, t, 1);
+		return m_Core.lower_bound(t, res);
+	}
+	template <class F, class S = STRUCT, class = std::enable_if_t<struct_is_ordered_v<S, TYPE>>>
+	size_t scan(const TYPE& from, size_t k, F&& f) const
+	{
+		record(OP_SCAN, from, k);
+		return m_Core.scan(from, k, std::forward<F>(f));
+	}
+	template <class S = STRUCT, class = std::enable_if_t<struct_is_hashed_v<S, TYPE>>>
+	static uint64_t hash(const TYPE& t)
+	{
+		return S::hash(t);
+	}
+	void clear()
+	{
+		m_Core.clear();
+	}
+	size_t size() const
+	{
+		return m_Core.size();
+	}
+	static constexpr const char *family = STRUCT::family;
+	static constexpr const char *name = STRUCT::name;
+	static constexpr bool use = true;
+	static constexpr bool concurrent = struct_is_concurrent_v<STRUCT>;
+
+	static void record(Op op, const TYPE& t, size_t scan = 0)
+	{
+		TraceWriter *writer = trace_writer();
+		if (writer != nullptr)
+			writer->add(op, trace_key(t), scan);
+	}
+
+	STRUCT m_Core;
+};
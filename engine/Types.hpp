@@ -29,34 +29,31 @@
 #include <cstring>
 #include <tuple>
 
-#include <PMurHash.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-enum {
-	MH_STRN_HASH_SEED = 13U
-};
-
-const size_t MAX_DATA_SIZE = 512 * 1024 * 1024;
-static inline char data_storage[MAX_DATA_SIZE];
+#include <Hash.hpp>
 
-inline uint32_t hash(const char *data, size_t size)
+/* Bijective mix of bits (splitmix64 finalizer). */
+inline uint64_t mix64(uint64_t x)
 {
-	uint32_t h = MH_STRN_HASH_SEED;
-	uint32_t carry = 0;
-	PMurHash32_Process(&h, &carry, data, size);
-	return PMurHash32_Result(h, carry, size);
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
 }
 
-inline uint32_t hash(const char *cdata)
-{
-	return hash(cdata, strlen(cdata));
-}
-
-inline size_t true_rand()
-{
-	return rand();
-	//return (size_t(rand()) << 10) ^ rand();
-}
+static const char *const key_letters =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz"
+	"0123456789+/";
 
+/*
+ * Traits of a key type. gen(r, strings) makes a key of a random number
+ * r, keys of types with STRING_SIZE > 0 refer to strings of up to that
+ * size that gen writes at strings and moves it past them. hash(t) hashes
+ * with the hash function of the run, hash(t, kind) with the given one.
+ */
 template <class TYPE>
 struct TypeTraits;
 
@@ -64,17 +61,15 @@ template <>
 struct TypeTraits<uint64_t> {
 	using TYPE = uint64_t;
 	static constexpr const char *name = "uint64_t";
-	static uint32_t hash(TYPE t) { return t; }
+	static uint64_t hash(TYPE t, HashKind kind = current_hash())
+	{
+		return hash_int(t, kind);
+	}
 	static int cmp(TYPE t1, TYPE t2) { return t1 < t2 ? -1 : t1 > t2; }
 	static bool same(TYPE t1, TYPE t2) { return t1 == t2; }
 	static bool equals(TYPE t1, TYPE t2) { return t1 == t2; }
-	static TYPE gen(size_t max) { return true_rand() % max; }
-	static void free_gen() { }
-	static TYPE*& data()
-	{
-		static TYPE *ptr = (TYPE*)data_storage;
-		return ptr;
-	}
+	static constexpr size_t STRING_SIZE = 0;
+	static TYPE gen(size_t r, char *&) { return r; }
 };
 
 struct char_ptr {
@@ -89,40 +84,25 @@ struct char_ptr {
 	}
 };
 
-namespace std {
-	template<>
-	struct hash<char_ptr> {
-		size_t operator()(char_ptr t) const { return ::hash(t.core); }
-	};
-}
-
 template <>
 struct TypeTraits<char_ptr> {
 	using TYPE = char_ptr;
 	static constexpr const char *name = "const char *";
-	static uint32_t hash(TYPE t) { return ::hash(t.core); }
+	static uint64_t hash(TYPE t, HashKind kind = current_hash())
+	{
+		return hash_bytes(t.core, strlen(t.core), kind);
+	}
 	static int cmp(TYPE t1, TYPE t2) { return strcmp(t1.core, t2.core); }
 	static bool same(TYPE t1, TYPE t2) { return t1.core == t2.core; }
 	static bool equals(TYPE t1, TYPE t2) { return cmp(t1, t2) == 0; }
-	static constexpr size_t ALLOC_SIZE = 16;
-	static char * StringBuf()
+	static constexpr size_t STRING_SIZE = 16;
+	static TYPE gen(size_t r, char *&strings)
 	{
-		static char storage[ALLOC_SIZE / sizeof(char_ptr) * MAX_DATA_SIZE];
-		return storage;
-	}
-	static size_t& stringBufPos() { static size_t pos; return pos; };
-	static TYPE gen(size_t max)
-	{
-		static const char * letters =
-			"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-			"abcdefghijklmnopqrstuvwxyz"
-			"0123456789+/";
-		size_t r = true_rand() % max;
+		const char *letters = key_letters;
 		size_t len = 10 + r % 4;
 		r /= 4;
-		assert(stringBufPos() < MAX_DATA_SIZE);
-		char *p = StringBuf() + stringBufPos() * ALLOC_SIZE;
-		stringBufPos()++;
+		char *p = strings;
+		strings += STRING_SIZE;
 		for (size_t i = 0; i < len; i++) {
 			p[i] = letters[r % 64];
 			r /= 64;
@@ -130,13 +110,169 @@ struct TypeTraits<char_ptr> {
 		p[len] = 0;
 		return TYPE{p};
 	};
-	static void free_gen()
+};
+
+/* 128-bit ID such as UUID, ordered as a big-endian number. */
+struct uuid128 {
+	uint64_t hi;
+	uint64_t lo;
+	bool operator<(const uuid128& other) const
+	{
+		return hi < other.hi || (hi == other.hi && lo < other.lo);
+	}
+	bool operator==(const uuid128& other) const
+	{
+		return hi == other.hi && lo == other.lo;
+	}
+};
+
+template <>
+struct TypeTraits<uuid128> {
+	using TYPE = uuid128;
+	static constexpr const char *name = "uuid128";
+	static uint64_t hash(TYPE t, HashKind kind = current_hash())
+	{
+		return hash_bytes((const char *)&t, sizeof(t), kind);
+	}
+	static int cmp(TYPE t1, TYPE t2) { return t1 < t2 ? -1 : t2 < t1; }
+	static bool same(TYPE t1, TYPE t2) { return t1 == t2; }
+	static bool equals(TYPE t1, TYPE t2) { return t1 == t2; }
+	/* Random version 4 UUID, the same for the same random number. */
+	static constexpr size_t STRING_SIZE = 0;
+	static TYPE gen(size_t r, char *&)
+	{
+		uint64_t hi = mix64(r);
+		uint64_t lo = mix64(~(uint64_t)r);
+		hi = (hi & ~0xf000ULL) | 0x4000ULL;
+		lo = (lo & ~(3ULL << 62)) | (2ULL << 62);
+		return TYPE{hi, lo};
+	}
+};
+
+/*
+ * String of up to N chars kept inline and padded with zeros, so memcmp
+ * of whole buffers orders strings as strcmp does and equality is checked
+ * 16 bytes at a time.
+ */
+template <size_t N>
+struct inline_str {
+	static_assert(N % 16 == 0, "compared by 16 bytes");
+	char core[N];
+	bool operator<(const inline_str& other) const
+	{
+		return memcmp(core, other.core, N) < 0;
+	}
+	bool operator==(const inline_str& other) const
+	{
+#if defined(__SSE2__)
+		int mask = 0xffff;
+		for (size_t i = 0; i < N; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(core + i));
+			__m128i b = _mm_loadu_si128((const __m128i *)(other.core + i));
+			mask &= _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+		}
+		return mask == 0xffff;
+#else
+		return memcmp(core, other.core, N) == 0;
+#endif
+	}
+};
+
+inline constexpr const char *inline_str_name(size_t n)
+{
+	return n == 16 ? "char[16]" :
+	       n == 32 ? "char[32]" :
+	       n == 64 ? "char[64]" : "char[N]";
+}
+
+template <size_t N>
+struct TypeTraits<inline_str<N>> {
+	using TYPE = inline_str<N>;
+	static constexpr const char *name = inline_str_name(N);
+	static uint64_t hash(const TYPE& t, HashKind kind = current_hash())
 	{
-		stringBufPos() = 0;
+		return hash_bytes(t.core, N, kind);
 	}
-	static TYPE*& data()
+	static int cmp(const TYPE& t1, const TYPE& t2)
+	{
+		return memcmp(t1.core, t2.core, N);
+	}
+	static bool same(const TYPE& t1, const TYPE& t2) { return t1 == t2; }
+	static bool equals(const TYPE& t1, const TYPE& t2) { return t1 == t2; }
+	/* Full length string like an encoded hash, 6 bits per char. */
+	static constexpr size_t STRING_SIZE = 0;
+	static TYPE gen(size_t r, char *&)
+	{
+		TYPE t;
+		uint64_t x = r;
+		for (size_t i = 0; i < N; i++) {
+			if (i % 10 == 0)
+				x = mix64(x + i);
+			t.core[i] = key_letters[x & 63];
+			x >>= 6;
+		}
+		return t;
+	}
+};
+
+/* Long string such as URL, compared as char_ptr. */
+struct long_str : char_ptr {};
+
+template <>
+struct TypeTraits<long_str> {
+	using TYPE = long_str;
+	static constexpr const char *name = "long string";
+	static uint64_t hash(TYPE t, HashKind kind = current_hash())
+	{
+		return hash_bytes(t.core, strlen(t.core), kind);
+	}
+	static int cmp(TYPE t1, TYPE t2) { return strcmp(t1.core, t2.core); }
+	static bool same(TYPE t1, TYPE t2) { return t1.core == t2.core; }
+	static bool equals(TYPE t1, TYPE t2) { return cmp(t1, t2) == 0; }
+	static constexpr size_t MIN_LEN = 40;
+	static constexpr size_t MAX_LEN = 200;
+	static constexpr size_t STRING_SIZE = MAX_LEN + 8;
+	/*
+	 * URL of a few common prefixes, an id that makes it unique and a
+	 * path. Length is MIN_LEN + (MAX_LEN - MIN_LEN) * u^2 for uniform u,
+	 * so short strings prevail: the mean is about 93 chars.
+	 */
+	static TYPE gen(size_t r, char *&strings)
+	{
+		static const char *const hosts[] = {
+			"https://www.example.com/",
+			"https://cdn.example.net/static/",
+			"http://shop.example.org/catalog/",
+			"https://api.example.io/v2/",
+		};
+		uint64_t x = mix64(r);
+		double u = (x >> 11) * 0x1p-53;
+		size_t len = MIN_LEN + (size_t)((MAX_LEN - MIN_LEN) * u * u);
+		const char *host = hosts[x % 4];
+
+		char *p = strings;
+		/* Strings are aligned as malloc would do it. */
+		strings += (len + 1 + 7) / 8 * 8;
+		size_t pos = strlen(host);
+		memcpy(p, host, pos);
+		for (size_t i = 0; i < 6; i++, r /= 64)
+			p[pos++] = key_letters[r % 64];
+		for (; pos < len; pos++) {
+			if (pos % 10 == 0)
+				x = mix64(x);
+			p[pos] = pos % 12 == 0 ? '/' : key_letters[x & 63];
+			x >>= 6;
+		}
+		p[len] = 0;
+		return TYPE{{p}};
+	}
+};
+
+/* Hasher of std containers, the same hash as other hash structs use. */
+template <typename TYPE>
+struct TypeHash {
+	size_t operator()(const TYPE& t) const
 	{
-		static TYPE *ptr = (TYPE *)data_storage;
-		return ptr;
+		return TypeTraits<TYPE>::hash(t);
 	}
 };
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Bind a thread to one core, cpu is taken modulo number of cores. */
+inline bool pin_to_cpu(pthread_t thread, size_t cpu)
+{
+	size_t cpus = std::thread::hardware_concurrency();
+	if (cpus == 0)
+		return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % cpus, &set);
+	return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+/*
+ * A set of threads (optionally pinned one per core) that run the same job
+ * together: all the workers wait on a barrier before calling the job, so
+ * they start the measured part as simultaneously as possible.
+ */
+class Workers {
+public:
+	inline Workers(size_t count, bool pin);
+	inline ~Workers();
+	Workers(const Workers&) = delete;
+	Workers& operator=(const Workers&) = delete;
+
+	/* Call job(id) in every worker and wait for all of them. */
+	inline void run(const std::function<void(size_t)>& job);
+
+	size_t size() const { return m_Count; }
+
+private:
+	inline void loop(size_t id);
+
+	size_t m_Count;
+	std::vector<std::thread> m_Threads;
+	std::mutex m_Mutex;
+	std::condition_variable m_Start;
+	std::condition_variable m_Finish;
+	const std::function<void(size_t)> *m_Job = nullptr;
+	size_t m_Generation = 0;
+	size_t m_Finished = 0;
+	bool m_Stop = false;
+	std::atomic<size_t> m_Arrived{0};
+};
+
+Workers::Workers(size_t count, bool pin) : m_Count(count)
+{
+	m_Threads.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		m_Threads.emplace_back(&Workers::loop, this, i);
+		if (pin)
+			pin_to_cpu(m_Threads.back().native_handle(), i);
+	}
+}
+
+Workers::~Workers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_Start.notify_all();
+	for (std::thread& t : m_Threads)
+		t.join();
+}
+
+void Workers::run(const std::function<void(size_t)>& job)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Job = &job;
+	m_Finished = 0;
+	m_Arrived = 0;
+	m_Generation++;
+	m_Start.notify_all();
+	m_Finish.wait(lock, [this] { return m_Finished == m_Count; });
+	m_Job = nullptr;
+}
+
+void Workers::loop(size_t id)
+{
+	size_t seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Start.wait(lock, [this, seen] {
+				return m_Stop || m_Generation != seen;
+			});
+			if (m_Stop)
+				return;
+			seen = m_Generation;
+		}
+
+		m_Arrived.fetch_add(1);
+		while (m_Arrived.load() < m_Count)
+			std::this_thread::yield();
+
+		(*m_Job)(id);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (++m_Finished == m_Count)
+			m_Finish.notify_one();
+	}
+}
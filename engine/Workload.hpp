@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <DataArena.hpp>
+
+/*
+ * How test queries are spread over the keys:
+ *  uniform - every key is queried once, in random order;
+ *  zipf    - key of rank k is queried with probability ~ 1 / k^theta;
+ *  hotspot - share of queries go to fraction of keys, uniformly;
+ *  latest  - zipf with ranks counted from the last inserted key.
+ */
+struct QueryDist {
+	enum Kind {
+		UNIFORM,
+		ZIPF,
+		HOTSPOT,
+		LATEST,
+	};
+
+	Kind kind = UNIFORM;
+	double theta = 0.99;
+	double hot_fraction = 0.2;
+	double hot_share = 0.8;
+	/* Shown in the report. */
+	std::string label = "uniform";
+
+	/* uniform, zipf[:THETA], hotspot[:FRACTION[:SHARE]], latest[:THETA] */
+	static bool parse(const std::string& str, QueryDist& dist)
+	{
+		dist = QueryDist{};
+		size_t colon = str.find(':');
+		std::string kind = str.substr(0, colon);
+		std::string params = colon == std::string::npos ? "" : str.substr(colon + 1);
+		char *end = nullptr;
+		char buf[64];
+		if (kind == "uniform") {
+			return params.empty();
+		} else if (kind == "zipf" || kind == "latest") {
+			dist.kind = kind == "zipf" ? ZIPF : LATEST;
+			if (!params.empty()) {
+				dist.theta = strtod(params.c_str(), &end);
+				if (*end != 0 || dist.theta <= 0)
+					return false;
+			}
+			snprintf(buf, sizeof(buf), "%s %g", kind.c_str(), dist.theta);
+		} else if (kind == "hotspot") {
+			dist.kind = HOTSPOT;
+			if (!params.empty()) {
+				dist.hot_fraction = strtod(params.c_str(), &end);
+				if (*end == ':')
+					dist.hot_share = strtod(end + 1, &end);
+				if (*end != 0)
+					return false;
+			}
+			if (dist.hot_fraction <= 0 || dist.hot_fraction > 1 ||
+			    dist.hot_share < 0 || dist.hot_share > 1)
+				return false;
+			snprintf(buf, sizeof(buf), "hot %g%%/%g%%",
+				 dist.hot_fraction * 100, dist.hot_share * 100);
+		} else {
+			return false;
+		}
+		dist.label = buf;
+		return true;
+	}
+};
+
+/*
+ * Zipf distributed ranks 1..n by rejection-inversion (W. Hormann,
+ * G. Derflinger), no O(n) setup unlike the classic zeta based method.
+ */
+class ZipfGenerator {
+public:
+	ZipfGenerator(size_t n, double theta) : m_N(n), m_Theta(theta)
+	{
+		m_HIntegralX1 = hIntegral(1.5) - 1;
+		m_HIntegralN = hIntegral(n + 0.5);
+		m_S = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+	}
+
+	template <class RNG>
+	size_t operator()(RNG& rng)
+	{
+		std::uniform_real_distribution<double> uniform(0, 1);
+		while (true) {
+			double u = m_HIntegralN +
+				   uniform(rng) * (m_HIntegralX1 - m_HIntegralN);
+			double x = hIntegralInverse(u);
+			double k = std::floor(x + 0.5);
+			k = k < 1 ? 1 : k > m_N ? m_N : k;
+			if (k - x <= m_S || u >= hIntegral(k + 0.5) - h(k))
+				return k;
+		}
+	}
+
+private:
+	double h(double x) const
+	{
+		return std::exp(-m_Theta * std::log(x));
+	}
+	double hIntegral(double x) const
+	{
+		double log_x = std::log(x);
+		return helper2((1 - m_Theta) * log_x) * log_x;
+	}
+	double hIntegralInverse(double x) const
+	{
+		double t = x * (1 - m_Theta);
+		if (t < -1)
+			t = -1;
+		return std::exp(helper1(t) * x);
+	}
+	/* log(1 + x) / x and (exp(x) - 1) / x, precise near zero. */
+	static double helper1(double x)
+	{
+		if (std::fabs(x) > 1e-8)
+			return std::log1p(x) / x;
+		return 1 - x * (0.5 - x * (1 / 3. - 0.25 * x));
+	}
+	static double helper2(double x)
+	{
+		if (std::fabs(x) > 1e-8)
+			return std::expm1(x) / x;
+		return 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+	}
+
+	double m_N;
+	double m_Theta;
+	double m_HIntegralX1;
+	double m_HIntegralN;
+	double m_S;
+};
+
+/*
+ * Index in [0, n) of a key to query. Ranks map to indexes directly, the
+ * keys are shuffled anyway; for LATEST the last index has rank 1.
+ */
+class QueryGenerator {
+public:
+	QueryGenerator(const QueryDist& dist, size_t n)
+		: m_Dist(dist), m_N(n), m_Zipf(n, dist.theta), m_Rng(n) {}
+
+	size_t operator()()
+	{
+		return (*this)(m_N);
+	}
+
+	/* The same for a key set that has grown or shrunk to n keys. */
+	size_t operator()(size_t n)
+	{
+		switch (m_Dist.kind) {
+		case QueryDist::ZIPF:
+			return (m_Zipf(m_Rng) - 1) % n;
+		case QueryDist::LATEST:
+			return n - 1 - (m_Zipf(m_Rng) - 1) % n;
+		case QueryDist::HOTSPOT: {
+			size_t hot = std::max<size_t>(1, n * m_Dist.hot_fraction);
+			std::uniform_real_distribution<double> coin(0, 1);
+			if (hot == n || coin(m_Rng) < m_Dist.hot_share)
+				return std::uniform_int_distribution<size_t>(0, hot - 1)(m_Rng);
+			return std::uniform_int_distribution<size_t>(hot, n - 1)(m_Rng);
+		}
+		default:
+			return std::uniform_int_distribution<size_t>(0, n - 1)(m_Rng);
+		}
+	}
+
+private:
+	const QueryDist& m_Dist;
+	size_t m_N;
+	ZipfGenerator m_Zipf;
+	std::mt19937_64 m_Rng;
+};
+
+/*
+ * Keys of a simulated set in the order of insertion: of the indexes below
+ * n the live ones are counted in a Fenwick tree, so the k-th oldest live
+ * key is found in O(log n) and removal of any key keeps the order.
+ */
+class LiveKeys {
+public:
+	/* Keys [0, count) are live, keys from count on are inserted next. */
+	LiveKeys(size_t n, size_t count)
+		: m_Tree(n + 1), m_Size(count), m_Next(count)
+	{
+		for (size_t i = 1; i <= count; i++)
+			m_Tree[i] = 1;
+		for (size_t i = 1; i <= n; i++) {
+			size_t up = i + (i & -i);
+			if (up <= n)
+				m_Tree[up] += m_Tree[i];
+		}
+		m_Top = 1;
+		while (m_Top * 2 <= n)
+			m_Top *= 2;
+	}
+
+	size_t size() const
+	{
+		return m_Size;
+	}
+
+	/* The k-th oldest live key, k < size(). */
+	size_t operator[](size_t k) const
+	{
+		size_t pos = 0;
+		for (size_t step = m_Top; step != 0; step /= 2) {
+			if (pos + step < m_Tree.size() && m_Tree[pos + step] <= k) {
+				pos += step;
+				k -= m_Tree[pos];
+			}
+		}
+		return pos;
+	}
+
+	/* Makes the next key live and returns it. */
+	size_t insert()
+	{
+		for (size_t i = m_Next + 1; i < m_Tree.size(); i += i & -i)
+			m_Tree[i]++;
+		m_Size++;
+		return m_Next++;
+	}
+
+	void remove(size_t key)
+	{
+		for (size_t i = key + 1; i < m_Tree.size(); i += i & -i)
+			m_Tree[i]--;
+		m_Size--;
+	}
+
+private:
+	std::vector<uint32_t> m_Tree;
+	size_t m_Size;
+	size_t m_Next;
+	size_t m_Top;
+};
+
+/* Array for test input prepared ahead of time. */
+template <typename TYPE>
+class MappedArray {
+public:
+	/* Elements from @from on are to be written, see DataArena::get. */
+	TYPE *get(size_t size, size_t from = 0)
+	{
+		return (TYPE *)m_Arena.get(size * sizeof(TYPE),
+					   from * sizeof(TYPE));
+	}
+
+private:
+	DataArena m_Arena;
+};
+
+/* Operations of mixed workloads. */
+enum Op : uint8_t {
+	OP_READ,
+	/* A set has no values, the key is removed and inserted back. */
+	OP_UPDATE,
+	OP_INSERT,
+	OP_DELETE,
+	/* Read, then update if found. */
+	OP_RMW,
+	OP_SCAN,
+	OP_COUNT
+};
+
+/* Shares of operations in a mixed workload, percents. */
+struct OpMix {
+	unsigned share[OP_COUNT];
+};
+
+/*
+ * Mixes of YCSB core workloads, ones with scans are run only for ordered
+ * structs. Shares are in the order of Op: read, update, insert, delete,
+ * rmw, scan.
+ */
+struct YcsbA {
+	static constexpr const char *name = "ycsb a";
+	static constexpr OpMix mix{{50, 50, 0, 0, 0, 0}};
+};
+
+struct YcsbB {
+	static constexpr const char *name = "ycsb b";
+	static constexpr OpMix mix{{95, 5, 0, 0, 0, 0}};
+};
+
+struct YcsbC {
+	static constexpr const char *name = "ycsb c";
+	static constexpr OpMix mix{{100, 0, 0, 0, 0, 0}};
+};
+
+struct YcsbD {
+	static constexpr const char *name = "ycsb d";
+	static constexpr OpMix mix{{95, 0, 5, 0, 0, 0}};
+};
+
+struct YcsbE {
+	static constexpr const char *name = "ycsb e";
+	static constexpr OpMix mix{{0, 0, 5, 0, 0, 95}};
+};
+
+struct YcsbF {
+	static constexpr const char *name = "ycsb f";
+	static constexpr OpMix mix{{50, 0, 0, 0, 50, 0}};
+};
+
+/* Set size stays about the same while most operations modify it. */
+struct WriteHeavy {
+	static constexpr const char *name = "write heavy";
+	static constexpr OpMix mix{{10, 0, 45, 45, 0, 0}};
+};
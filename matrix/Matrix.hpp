@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <Runner.hpp>
+#include <Types.hpp>
+#include <Structs.hpp>
+#include <Tests.hpp>
+
+#include <ArtStruct.hpp>
+#include <BPlusTreeStruct.hpp>
+#include <SwissSetStruct.hpp>
+
+using sizes = std::index_sequence<
+	1024,
+	32 * 1024,
+	1 * 1024 * 1024,
+	16 * 1024 * 1024,
+	0>;
+
+template <typename TYPE>
+using structs = std::tuple<
+	StdSetStruct<TYPE>,
+	LockedStdSetStruct<TYPE>,
+	BPlusTreeStruct<TYPE, 64>,
+	BPlusTreeStruct<TYPE, 128>,
+	BPlusTreeStruct<TYPE, 256>,
+	ArtStruct<TYPE>,
+	nullptr_t
+>;
+
+template <typename TYPE>
+using hash_structs = std::tuple<
+	StdUnorderedSetStruct<TYPE>,
+	LockedStdUnorderedSetStruct<TYPE>,
+	SwissSetStruct<TYPE>,
+	nullptr_t
+>;
+
+/* std containers with allocators of their own, see Allocators.hpp. */
+template <typename TYPE>
+using alloc_structs = std::tuple<
+	SlabStdSetStruct<TYPE>,
+	ArenaStdSetStruct<TYPE>,
+	PmrPoolStdSetStruct<TYPE>,
+	PmrMonoStdSetStruct<TYPE>,
+	SlabStdUnorderedSetStruct<TYPE>,
+	ArenaStdUnorderedSetStruct<TYPE>,
+	PmrPoolStdUnorderedSetStruct<TYPE>,
+	PmrMonoStdUnorderedSetStruct<TYPE>,
+	nullptr_t
+>;
+
+template <size_t SIZE, typename TYPE, class STRUCT>
+using tests = std::tuple<
+	Insert<SIZE, TYPE, STRUCT>,
+	InsertBatched<SIZE, TYPE, STRUCT>,
+	BulkLoad<false>::Test<SIZE, TYPE, STRUCT>,
+	BulkLoad<true>::Test<SIZE, TYPE, STRUCT>,
+	Delete<SIZE, TYPE, STRUCT>,
+	SearchHit<SIZE, TYPE, STRUCT>,
+	SearchHitBatched<SIZE, TYPE, STRUCT>,
+	SearchMiss<SIZE, TYPE, STRUCT>,
+	SearchMissBatched<SIZE, TYPE, STRUCT>,
+	SearchMixed<SIZE, TYPE, STRUCT>,
+	Successor<SIZE, TYPE, STRUCT>,
+	RangeScan<10>::Test<SIZE, TYPE, STRUCT>,
+	RangeScan<100>::Test<SIZE, TYPE, STRUCT>,
+	RandWorkload<SIZE, TYPE, STRUCT>,
+	Mixed<YcsbA>::Test<SIZE, TYPE, STRUCT>,
+	Mixed<YcsbB>::Test<SIZE, TYPE, STRUCT>,
+	Mixed<YcsbC>::Test<SIZE, TYPE, STRUCT>,
+	Mixed<YcsbD>::Test<SIZE, TYPE, STRUCT>,
+	Mixed<YcsbE>::Test<SIZE, TYPE, STRUCT>,
+	Mixed<YcsbF>::Test<SIZE, TYPE, STRUCT>,
+	Mixed<WriteHeavy>::Test<SIZE, TYPE, STRUCT>,
+	Replay<SIZE, TYPE, STRUCT>,
+	nullptr_t
+>;
+
+/* The hash of keys does not depend on the struct, it is tested once. */
+template <typename TYPE>
+using key_hash_structs = std::tuple<
+	KeyHashStruct<TYPE>,
+	nullptr_t
+>;
+
+template <size_t SIZE, typename TYPE, class STRUCT>
+using hash_tests = std::tuple<
+	Hashing<SIZE, TYPE, STRUCT>,
+	nullptr_t
+>;
+
+using types = std::tuple<
+	uint64_t,
+	char_ptr,
+	uuid128,
+	inline_str<32>,
+	long_str
+>;
+
+/*
+ * Cells of the matrix with one type of keys and one list of structs. The
+ * whole matrix is too big for a compiler to instantiate at once, so every
+ * part is instantiated in its own unit, see extern templates below.
+ */
+template <typename TYPE, template <typename> class STRUCTS,
+	  template <size_t, typename, class> class TESTS = tests>
+const std::vector<TestCell>& type_cells()
+{
+	return AllTests<sizes, std::tuple<TYPE>, STRUCTS, TESTS>::cells();
+}
+
+extern template const std::vector<TestCell>& type_cells<uint64_t, structs>();
+extern template const std::vector<TestCell>& type_cells<uint64_t, hash_structs>();
+extern template const std::vector<TestCell>& type_cells<uint64_t, alloc_structs>();
+extern template const std::vector<TestCell>& type_cells<uint64_t, key_hash_structs, hash_tests>();
+extern template const std::vector<TestCell>& type_cells<char_ptr, structs>();
+extern template const std::vector<TestCell>& type_cells<char_ptr, hash_structs>();
+extern template const std::vector<TestCell>& type_cells<char_ptr, alloc_structs>();
+extern template const std::vector<TestCell>& type_cells<char_ptr, key_hash_structs, hash_tests>();
+extern template const std::vector<TestCell>& type_cells<uuid128, structs>();
+extern template const std::vector<TestCell>& type_cells<uuid128, hash_structs>();
+extern template const std::vector<TestCell>& type_cells<uuid128, alloc_structs>();
+extern template const std::vector<TestCell>& type_cells<uuid128, key_hash_structs, hash_tests>();
+extern template const std::vector<TestCell>& type_cells<inline_str<32>, structs>();
+extern template const std::vector<TestCell>& type_cells<inline_str<32>, hash_structs>();
+extern template const std::vector<TestCell>& type_cells<inline_str<32>, alloc_structs>();
+extern template const std::vector<TestCell>& type_cells<inline_str<32>, key_hash_structs, hash_tests>();
+extern template const std::vector<TestCell>& type_cells<long_str, structs>();
+extern template const std::vector<TestCell>& type_cells<long_str, hash_structs>();
+extern template const std::vector<TestCell>& type_cells<long_str, alloc_structs>();
+extern template const std::vector<TestCell>& type_cells<long_str, key_hash_structs, hash_tests>();
+
+/* Cells of all the types in the order of one matrix: by size, then type. */
+template <typename... TYPE>
+std::vector<TestCell> matrix_cells(std::tuple<TYPE...>)
+{
+	std::vector<TestCell> cells;
+	auto add = [&cells](const std::vector<TestCell>& part) {
+		cells.insert(cells.end(), part.begin(), part.end());
+	};
+	((add(type_cells<TYPE, structs>()),
+	  add(type_cells<TYPE, hash_structs>()),
+	  add(type_cells<TYPE, alloc_structs>()),
+	  add(type_cells<TYPE, key_hash_structs, hash_tests>())), ...);
+	std::stable_sort(cells.begin(), cells.end(),
+			 [](const TestCell& a, const TestCell& b) {
+				 return a.size < b.size;
+			 });
+	return cells;
+}
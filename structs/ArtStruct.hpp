@@ -0,0 +1,716 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <Types.hpp>
+
+namespace art {
+
+/*
+ * Binary comparable representation of keys: byte(k, i) for i < length(k),
+ * ordered the same way as TypeTraits<TYPE>::cmp and prefix free. Keys that
+ * are embeddable are stored in a tagged child word and need no leaf node,
+ * embed() must leave two lowest bits clear.
+ */
+template <typename TYPE>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<uint64_t> {
+	static size_t length(uint64_t) { return sizeof(uint64_t); }
+	static uint8_t byte(uint64_t k, size_t i) { return k >> (56 - i * 8); }
+	static bool embeddable(uint64_t k) { return (k >> 62) == 0; }
+	static uintptr_t embed(uint64_t k) { return k << 2; }
+	static uint64_t extract(uintptr_t w) { return w >> 2; }
+};
+
+template <>
+struct KeyTraits<char_ptr> {
+	static size_t length(char_ptr k) { return strlen(k.core) + 1; }
+	static uint8_t byte(char_ptr k, size_t i) { return k.core[i]; }
+	static bool embeddable(char_ptr k) { return ((uintptr_t)k.core & 3) == 0; }
+	static uintptr_t embed(char_ptr k) { return (uintptr_t)k.core; }
+	static char_ptr extract(uintptr_t w) { return char_ptr{(const char *)w}; }
+};
+
+/* Fixed length keys that are too wide to be embedded. */
+template <typename TYPE>
+struct BoxedKeyTraits {
+	static bool embeddable(const TYPE&) { return false; }
+	static uintptr_t embed(const TYPE&) { return 0; }
+	static TYPE extract(uintptr_t) { return TYPE{}; }
+};
+
+template <>
+struct KeyTraits<uuid128> : BoxedKeyTraits<uuid128> {
+	static size_t length(const uuid128&) { return sizeof(uuid128); }
+	static uint8_t byte(const uuid128& k, size_t i)
+	{
+		return i < 8 ? k.hi >> (56 - i * 8) : k.lo >> (120 - i * 8);
+	}
+};
+
+template <size_t N>
+struct KeyTraits<inline_str<N>> : BoxedKeyTraits<inline_str<N>> {
+	static size_t length(const inline_str<N>&) { return N; }
+	static uint8_t byte(const inline_str<N>& k, size_t i) { return k.core[i]; }
+};
+
+template <>
+struct KeyTraits<long_str> : KeyTraits<char_ptr> {
+	static long_str extract(uintptr_t w) { return long_str{{(const char *)w}}; }
+};
+
+} // namespace art {
+
+/*
+ * Adaptive radix tree (Leis et al.): inner nodes of 4, 16, 48 and 256
+ * children grow and shrink with their fanout, single child chains are
+ * compressed into node prefixes (only first MAX_PREFIX bytes are stored,
+ * the rest is checked against a leaf) and a leaf is created as late as
+ * possible - a child slot holding a key that is the only one in its
+ * subtree.
+ */
+template <typename TYPE>
+struct ArtStruct {
+	using Key = art::KeyTraits<TYPE>;
+	static constexpr size_t MAX_PREFIX = 8;
+
+	enum NodeType : uint8_t {
+		NODE4,
+		NODE16,
+		NODE48,
+		NODE256,
+	};
+
+	struct Node {
+		uint8_t m_Type;
+		uint16_t m_Count;
+		uint32_t m_PrefixLen;
+		uint8_t m_Prefix[MAX_PREFIX];
+	};
+	struct Node4 : Node {
+		static constexpr NodeType TYPE_ID = NODE4;
+		uint8_t m_Keys[4];
+		uintptr_t m_Children[4];
+	};
+	struct Node16 : Node {
+		static constexpr NodeType TYPE_ID = NODE16;
+		uint8_t m_Keys[16];
+		uintptr_t m_Children[16];
+	};
+	struct Node48 : Node {
+		static constexpr NodeType TYPE_ID = NODE48;
+		uint8_t m_Index[256];
+		uintptr_t m_Children[48];
+	};
+	struct Node256 : Node {
+		static constexpr NodeType TYPE_ID = NODE256;
+		uintptr_t m_Children[256];
+	};
+
+	/* Child word tags: leaf with a key inside or a pointer to a boxed key. */
+	enum : uintptr_t {
+		LEAF = 1,
+		BOXED = 2,
+		TAGS = LEAF | BOXED,
+	};
+	struct Box {
+		TYPE m_Key;
+	};
+
+	ArtStruct() = default;
+	ArtStruct(const ArtStruct&) = delete;
+	ArtStruct& operator=(const ArtStruct&) = delete;
+	~ArtStruct()
+	{
+		clear();
+	}
+
+	bool insert(const TYPE& t)
+	{
+		if (!insert(m_Root, t, 0))
+			return false;
+		m_Size++;
+		return true;
+	}
+	bool remove(const TYPE& t)
+	{
+		if (m_Root == 0)
+			return false;
+		if (isLeaf(m_Root)) {
+			if (!TypeTraits<TYPE>::equals(leafKey(m_Root), t))
+				return false;
+			freeLeaf(m_Root);
+			m_Root = 0;
+		} else if (!remove(m_Root, t, Key::length(t), 0)) {
+			return false;
+		}
+		m_Size--;
+		return true;
+	}
+	bool has(const TYPE& t) const
+	{
+		size_t len = Key::length(t);
+		size_t depth = 0;
+		uintptr_t w = m_Root;
+		while (w != 0) {
+			if (isLeaf(w))
+				return TypeTraits<TYPE>::equals(leafKey(w), t);
+			const Node *n = (const Node *)w;
+			if (n->m_PrefixLen != 0) {
+				if (checkPrefix(n, t, depth) != storedPrefix(n))
+					return false;
+				depth += n->m_PrefixLen;
+			}
+			if (depth >= len)
+				return false;
+			const uintptr_t *child = findChild(n, Key::byte(t, depth));
+			if (child == nullptr)
+				return false;
+			w = *child;
+			depth++;
+		}
+		return false;
+	}
+	void clear()
+	{
+		destroy(m_Root);
+		m_Root = 0;
+		m_Size = 0;
+	}
+	size_t size() const
+	{
+		return m_Size;
+	}
+	/* Call f for every key in ascending order. */
+	template <class F>
+	void foreach(F&& f) const
+	{
+		foreach(m_Root, f);
+	}
+	static constexpr const char *family = "trie";
+	static constexpr const char *name = "art";
+	static constexpr bool use = true;
+
+private:
+	static bool isLeaf(uintptr_t w)
+	{
+		return (w & LEAF) != 0;
+	}
+	static TYPE leafKey(uintptr_t w)
+	{
+		if (w & BOXED)
+			return ((const Box *)(w & ~TAGS))->m_Key;
+		return Key::extract(w & ~TAGS);
+	}
+	static uintptr_t makeLeaf(const TYPE& t)
+	{
+		if (Key::embeddable(t))
+			return Key::embed(t) | LEAF;
+		Box *box = (Box *)malloc(sizeof(Box));
+		if (box == nullptr)
+			throw std::bad_alloc();
+		box->m_Key = t;
+		return (uintptr_t)box | BOXED | LEAF;
+	}
+	static void freeLeaf(uintptr_t w)
+	{
+		if (w & BOXED)
+			free((void *)(w & ~TAGS));
+	}
+
+	template <class NODE>
+	static NODE *alloc()
+	{
+		NODE *n = (NODE *)calloc(1, sizeof(NODE));
+		if (n == nullptr)
+			throw std::bad_alloc();
+		n->m_Type = NODE::TYPE_ID;
+		return n;
+	}
+	template <class NODE>
+	static NODE *morph(const Node *old)
+	{
+		NODE *n = alloc<NODE>();
+		n->m_Count = old->m_Count;
+		n->m_PrefixLen = old->m_PrefixLen;
+		memcpy(n->m_Prefix, old->m_Prefix, MAX_PREFIX);
+		return n;
+	}
+
+	static size_t storedPrefix(const Node *n)
+	{
+		return std::min<size_t>(n->m_PrefixLen, MAX_PREFIX);
+	}
+	static void setPrefix(Node *n, const TYPE& t, size_t depth, size_t len)
+	{
+		n->m_PrefixLen = len;
+		for (size_t i = 0; i < std::min(len, MAX_PREFIX); i++)
+			n->m_Prefix[i] = Key::byte(t, depth + i);
+	}
+	/* Number of matching stored prefix bytes, the rest is optimistic. */
+	static size_t checkPrefix(const Node *n, const TYPE& t, size_t depth)
+	{
+		size_t stored = storedPrefix(n);
+		for (size_t i = 0; i < stored; i++)
+			if (n->m_Prefix[i] != Key::byte(t, depth + i))
+				return i;
+		return stored;
+	}
+	/* Exact position of the first prefix mismatch. */
+	static size_t prefixMismatch(const Node *n, const TYPE& t, size_t depth)
+	{
+		size_t i = checkPrefix(n, t, depth);
+		if (i < storedPrefix(n) || n->m_PrefixLen <= MAX_PREFIX)
+			return i;
+		TYPE min = leafKey(minimum((uintptr_t)n));
+		for (; i < n->m_PrefixLen; i++)
+			if (Key::byte(min, depth + i) != Key::byte(t, depth + i))
+				return i;
+		return i;
+	}
+	static uintptr_t minimum(uintptr_t w)
+	{
+		while (!isLeaf(w)) {
+			const Node *n = (const Node *)w;
+			switch (n->m_Type) {
+			case NODE4:
+				w = ((const Node4 *)n)->m_Children[0];
+				break;
+			case NODE16:
+				w = ((const Node16 *)n)->m_Children[0];
+				break;
+			case NODE48: {
+				const Node48 *n48 = (const Node48 *)n;
+				size_t b = 0;
+				while (n48->m_Index[b] == 0)
+					b++;
+				w = n48->m_Children[n48->m_Index[b] - 1];
+				break;
+			}
+			default: {
+				const Node256 *n256 = (const Node256 *)n;
+				size_t b = 0;
+				while (n256->m_Children[b] == 0)
+					b++;
+				w = n256->m_Children[b];
+				break;
+			}
+			}
+		}
+		return w;
+	}
+
+	static const uintptr_t *findChild(const Node *n, uint8_t b)
+	{
+		switch (n->m_Type) {
+		case NODE4: {
+			const Node4 *n4 = (const Node4 *)n;
+			for (size_t i = 0; i < n4->m_Count; i++)
+				if (n4->m_Keys[i] == b)
+					return &n4->m_Children[i];
+			return nullptr;
+		}
+		case NODE16: {
+			const Node16 *n16 = (const Node16 *)n;
+#if defined(__SSE2__)
+			__m128i keys = _mm_loadu_si128((const __m128i *)n16->m_Keys);
+			__m128i cmp = _mm_cmpeq_epi8(keys, _mm_set1_epi8(b));
+			unsigned mask = _mm_movemask_epi8(cmp) &
+					((1u << n16->m_Count) - 1);
+			return mask != 0 ?
+				&n16->m_Children[__builtin_ctz(mask)] : nullptr;
+#else
+			for (size_t i = 0; i < n16->m_Count; i++)
+				if (n16->m_Keys[i] == b)
+					return &n16->m_Children[i];
+			return nullptr;
+#endif
+		}
+		case NODE48: {
+			const Node48 *n48 = (const Node48 *)n;
+			uint8_t i = n48->m_Index[b];
+			return i != 0 ? &n48->m_Children[i - 1] : nullptr;
+		}
+		default: {
+			const Node256 *n256 = (const Node256 *)n;
+			return n256->m_Children[b] != 0 ?
+				&n256->m_Children[b] : nullptr;
+		}
+		}
+	}
+	static uintptr_t *findChild(Node *n, uint8_t b)
+	{
+		return const_cast<uintptr_t *>(findChild((const Node *)n, b));
+	}
+
+	/* Insert into a sorted node of 4 or 16 children that has room. */
+	template <class NODE>
+	static void addSorted(NODE *n, uint8_t b, uintptr_t child)
+	{
+		size_t i = 0;
+		while (i < n->m_Count && n->m_Keys[i] < b)
+			i++;
+		memmove(n->m_Keys + i + 1, n->m_Keys + i, n->m_Count - i);
+		memmove(n->m_Children + i + 1, n->m_Children + i,
+			(n->m_Count - i) * sizeof(uintptr_t));
+		n->m_Keys[i] = b;
+		n->m_Children[i] = child;
+		n->m_Count++;
+	}
+	static void add48(Node48 *n, uint8_t b, uintptr_t child)
+	{
+		size_t slot = 0;
+		while (n->m_Children[slot] != 0)
+			slot++;
+		n->m_Children[slot] = child;
+		n->m_Index[b] = slot + 1;
+		n->m_Count++;
+	}
+
+	static void addChild(uintptr_t& ref, uint8_t b, uintptr_t child)
+	{
+		Node *n = (Node *)ref;
+		switch (n->m_Type) {
+		case NODE4: {
+			Node4 *n4 = (Node4 *)n;
+			if (n4->m_Count < 4) {
+				addSorted(n4, b, child);
+				return;
+			}
+			Node16 *n16 = morph<Node16>(n4);
+			memcpy(n16->m_Keys, n4->m_Keys, 4);
+			memcpy(n16->m_Children, n4->m_Children, sizeof(n4->m_Children));
+			free(n4);
+			ref = (uintptr_t)n16;
+			addSorted(n16, b, child);
+			return;
+		}
+		case NODE16: {
+			Node16 *n16 = (Node16 *)n;
+			if (n16->m_Count < 16) {
+				addSorted(n16, b, child);
+				return;
+			}
+			Node48 *n48 = morph<Node48>(n16);
+			for (size_t i = 0; i < 16; i++) {
+				n48->m_Index[n16->m_Keys[i]] = i + 1;
+				n48->m_Children[i] = n16->m_Children[i];
+			}
+			free(n16);
+			ref = (uintptr_t)n48;
+			add48(n48, b, child);
+			return;
+		}
+		case NODE48: {
+			Node48 *n48 = (Node48 *)n;
+			if (n48->m_Count < 48) {
+				add48(n48, b, child);
+				return;
+			}
+			Node256 *n256 = morph<Node256>(n48);
+			for (size_t i = 0; i < 256; i++)
+				if (n48->m_Index[i] != 0)
+					n256->m_Children[i] =
+						n48->m_Children[n48->m_Index[i] - 1];
+			free(n48);
+			ref = (uintptr_t)n256;
+			n256->m_Children[b] = child;
+			n256->m_Count++;
+			return;
+		}
+		default: {
+			Node256 *n256 = (Node256 *)n;
+			n256->m_Children[b] = child;
+			n256->m_Count++;
+			return;
+		}
+		}
+	}
+
+	static void removeChild(uintptr_t& ref, uint8_t b, uintptr_t *child)
+	{
+		Node *n = (Node *)ref;
+		switch (n->m_Type) {
+		case NODE4: {
+			Node4 *n4 = (Node4 *)n;
+			size_t i = child - n4->m_Children;
+			memmove(n4->m_Keys + i, n4->m_Keys + i + 1, n4->m_Count - i - 1);
+			memmove(n4->m_Children + i, n4->m_Children + i + 1,
+				(n4->m_Count - i - 1) * sizeof(uintptr_t));
+			if (--n4->m_Count == 1)
+				collapse(ref);
+			return;
+		}
+		case NODE16: {
+			Node16 *n16 = (Node16 *)n;
+			size_t i = child - n16->m_Children;
+			memmove(n16->m_Keys + i, n16->m_Keys + i + 1, n16->m_Count - i - 1);
+			memmove(n16->m_Children + i, n16->m_Children + i + 1,
+				(n16->m_Count - i - 1) * sizeof(uintptr_t));
+			if (--n16->m_Count > 3)
+				return;
+			Node4 *n4 = morph<Node4>(n16);
+			memcpy(n4->m_Keys, n16->m_Keys, 3);
+			memcpy(n4->m_Children, n16->m_Children, 3 * sizeof(uintptr_t));
+			free(n16);
+			ref = (uintptr_t)n4;
+			return;
+		}
+		case NODE48: {
+			Node48 *n48 = (Node48 *)n;
+			n48->m_Children[n48->m_Index[b] - 1] = 0;
+			n48->m_Index[b] = 0;
+			if (--n48->m_Count > 12)
+				return;
+			Node16 *n16 = morph<Node16>(n48);
+			size_t j = 0;
+			for (size_t i = 0; i < 256; i++) {
+				if (n48->m_Index[i] == 0)
+					continue;
+				n16->m_Keys[j] = i;
+				n16->m_Children[j] = n48->m_Children[n48->m_Index[i] - 1];
+				j++;
+			}
+			free(n48);
+			ref = (uintptr_t)n16;
+			return;
+		}
+		default: {
+			Node256 *n256 = (Node256 *)n;
+			n256->m_Children[b] = 0;
+			if (--n256->m_Count > 37)
+				return;
+			Node48 *n48 = morph<Node48>(n256);
+			size_t j = 0;
+			for (size_t i = 0; i < 256; i++) {
+				if (n256->m_Children[i] == 0)
+					continue;
+				n48->m_Children[j] = n256->m_Children[i];
+				n48->m_Index[i] = ++j;
+			}
+			free(n256);
+			ref = (uintptr_t)n48;
+			return;
+		}
+		}
+	}
+
+	/* Replace a node of one child with that child, merging prefixes. */
+	static void collapse(uintptr_t& ref)
+	{
+		Node4 *n4 = (Node4 *)ref;
+		uintptr_t child = n4->m_Children[0];
+		if (!isLeaf(child)) {
+			Node *c = (Node *)child;
+			size_t len = n4->m_PrefixLen;
+			if (len < MAX_PREFIX)
+				n4->m_Prefix[len++] = n4->m_Keys[0];
+			if (len < MAX_PREFIX) {
+				size_t more = std::min(storedPrefix(c), MAX_PREFIX - len);
+				memcpy(n4->m_Prefix + len, c->m_Prefix, more);
+				len += more;
+			}
+			memcpy(c->m_Prefix, n4->m_Prefix, std::min(len, MAX_PREFIX));
+			c->m_PrefixLen += n4->m_PrefixLen + 1;
+		}
+		free(n4);
+		ref = child;
+	}
+
+	static bool insert(uintptr_t& ref, const TYPE& t, size_t depth)
+	{
+		if (ref == 0) {
+			ref = makeLeaf(t);
+			return true;
+		}
+		if (isLeaf(ref)) {
+			TYPE other = leafKey(ref);
+			if (TypeTraits<TYPE>::equals(other, t))
+				return false;
+			size_t lcp = 0;
+			while (Key::byte(other, depth + lcp) == Key::byte(t, depth + lcp))
+				lcp++;
+			Node4 *n4 = alloc<Node4>();
+			setPrefix(n4, t, depth, lcp);
+			addSorted(n4, Key::byte(other, depth + lcp), ref);
+			addSorted(n4, Key::byte(t, depth + lcp), makeLeaf(t));
+			ref = (uintptr_t)n4;
+			return true;
+		}
+
+		Node *n = (Node *)ref;
+		if (n->m_PrefixLen != 0) {
+			size_t diff = prefixMismatch(n, t, depth);
+			if (diff < n->m_PrefixLen) {
+				Node4 *n4 = alloc<Node4>();
+				setPrefix(n4, t, depth, diff);
+				uint8_t b;
+				if (n->m_PrefixLen <= MAX_PREFIX) {
+					b = n->m_Prefix[diff];
+					n->m_PrefixLen -= diff + 1;
+					memmove(n->m_Prefix, n->m_Prefix + diff + 1,
+						n->m_PrefixLen);
+				} else {
+					TYPE min = leafKey(minimum(ref));
+					b = Key::byte(min, depth + diff);
+					n->m_PrefixLen -= diff + 1;
+					for (size_t i = 0; i < storedPrefix(n); i++)
+						n->m_Prefix[i] =
+							Key::byte(min, depth + diff + 1 + i);
+				}
+				addSorted(n4, b, ref);
+				addSorted(n4, Key::byte(t, depth + diff), makeLeaf(t));
+				ref = (uintptr_t)n4;
+				return true;
+			}
+			depth += n->m_PrefixLen;
+		}
+
+		uint8_t b = Key::byte(t, depth);
+		uintptr_t *child = findChild(n, b);
+		if (child != nullptr)
+			return insert(*child, t, depth + 1);
+		addChild(ref, b, makeLeaf(t));
+		return true;
+	}
+
+	static bool remove(uintptr_t& ref, const TYPE& t, size_t len, size_t depth)
+	{
+		Node *n = (Node *)ref;
+		if (n->m_PrefixLen != 0) {
+			if (checkPrefix(n, t, depth) != storedPrefix(n))
+				return false;
+			depth += n->m_PrefixLen;
+		}
+		if (depth >= len)
+			return false;
+		uint8_t b = Key::byte(t, depth);
+		uintptr_t *child = findChild(n, b);
+		if (child == nullptr)
+			return false;
+		if (!isLeaf(*child))
+			return remove(*child, t, len, depth + 1);
+		if (!TypeTraits<TYPE>::equals(leafKey(*child), t))
+			return false;
+		freeLeaf(*child);
+		removeChild(ref, b, child);
+		return true;
+	}
+
+	template <class F>
+	static void foreach(uintptr_t w, F& f)
+	{
+		if (w == 0)
+			return;
+		if (isLeaf(w)) {
+			f(leafKey(w));
+			return;
+		}
+		const Node *n = (const Node *)w;
+		switch (n->m_Type) {
+		case NODE4: {
+			const Node4 *n4 = (const Node4 *)n;
+			for (size_t i = 0; i < n4->m_Count; i++)
+				foreach(n4->m_Children[i], f);
+			break;
+		}
+		case NODE16: {
+			const Node16 *n16 = (const Node16 *)n;
+			for (size_t i = 0; i < n16->m_Count; i++)
+				foreach(n16->m_Children[i], f);
+			break;
+		}
+		case NODE48: {
+			const Node48 *n48 = (const Node48 *)n;
+			for (size_t i = 0; i < 256; i++)
+				if (n48->m_Index[i] != 0)
+					foreach(n48->m_Children[n48->m_Index[i] - 1], f);
+			break;
+		}
+		default: {
+			const Node256 *n256 = (const Node256 *)n;
+			for (size_t i = 0; i < 256; i++)
+				foreach(n256->m_Children[i], f);
+			break;
+		}
+		}
+	}
+
+	static void destroy(uintptr_t w)
+	{
+		if (w == 0)
+			return;
+		if (isLeaf(w)) {
+			freeLeaf(w);
+			return;
+		}
+		Node *n = (Node *)w;
+		switch (n->m_Type) {
+		case NODE4: {
+			Node4 *n4 = (Node4 *)n;
+			for (size_t i = 0; i < n4->m_Count; i++)
+				destroy(n4->m_Children[i]);
+			break;
+		}
+		case NODE16: {
+			Node16 *n16 = (Node16 *)n;
+			for (size_t i = 0; i < n16->m_Count; i++)
+				destroy(n16->m_Children[i]);
+			break;
+		}
+		case NODE48: {
+			Node48 *n48 = (Node48 *)n;
+			for (size_t i = 0; i < 48; i++)
+				destroy(n48->m_Children[i]);
+			break;
+		}
+		default: {
+			Node256 *n256 = (Node256 *)n;
+			for (size_t i = 0; i < 256; i++)
+				destroy(n256->m_Children[i]);
+			break;
+		}
+		}
+		free(n);
+	}
+
+	uintptr_t m_Root = 0;
+	size_t m_Size = 0;
+};
@@ -0,0 +1,601 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include <Types.hpp>
+
+namespace bplus {
+
+/*
+ * Count of keys in a sorted node that are less than (STRICT) or not
+ * greater than the given key, i.e. the lower or upper bound position.
+ * Generic keys are searched with binary search, integer keys with a
+ * branchless linear scan of the keys in use that is done with SIMD
+ * (AVX2 or SSE4.2, see SIMD option of the build).
+ */
+template <typename TYPE>
+struct Search {
+	template <bool STRICT, size_t CAP>
+	static size_t count(const TYPE *keys, size_t n, const TYPE& key)
+	{
+		size_t lo = 0;
+		while (n > 0) {
+			size_t half = n / 2;
+			int c = TypeTraits<TYPE>::cmp(keys[lo + half], key);
+			if (STRICT ? c < 0 : c <= 0) {
+				lo += half + 1;
+				n -= half + 1;
+			} else {
+				n = half;
+			}
+		}
+		return lo;
+	}
+};
+
+/*
+ * Keys are compared as signed after their sign bit is flipped. Keys past
+ * n are never written, so they are not read: the tail that does not fill
+ * a vector is counted one by one.
+ */
+template <>
+struct Search<uint64_t> {
+	template <bool STRICT, size_t CAP>
+	static size_t count(const uint64_t *keys, size_t n, uint64_t key)
+	{
+		size_t res = 0;
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+		const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), sign);
+		for (; i + 4 <= n; i += 4) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+			v = _mm256_xor_si256(v, sign);
+			__m256i m = STRICT ? _mm256_cmpgt_epi64(k, v) :
+				_mm256_cmpgt_epi64(v, k);
+			int bits = __builtin_popcount(
+				_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+			res += STRICT ? bits : 4 - bits;
+		}
+#elif defined(__SSE4_2__)
+		const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+		const __m128i k = _mm_xor_si128(_mm_set1_epi64x(key), sign);
+		for (; i + 2 <= n; i += 2) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+			v = _mm_xor_si128(v, sign);
+			__m128i m = STRICT ? _mm_cmpgt_epi64(k, v) :
+				_mm_cmpgt_epi64(v, k);
+			int bits = __builtin_popcount(
+				_mm_movemask_pd(_mm_castsi128_pd(m)));
+			res += STRICT ? bits : 2 - bits;
+		}
+#endif
+		for (; i < n; i++)
+			res += STRICT ? keys[i] < key : keys[i] <= key;
+		return res;
+	}
+};
+
+inline constexpr const char *name(size_t node_size)
+{
+	return node_size == 64 ? "b+tree 64" :
+	       node_size == 128 ? "b+tree 128" :
+	       node_size == 256 ? "b+tree 256" : "b+tree";
+}
+
+} // namespace bplus {
+
+/*
+ * B+tree with nodes of NODE_SIZE bytes: keys live only in leaves which
+ * are linked into a list, inner nodes keep separators and children.
+ * Separator i is the lowest bound of keys of child i + 1.
+ */
+template <typename TYPE, size_t NODE_SIZE>
+struct BPlusTreeStruct {
+	struct Node {
+		uint32_t m_Count;
+	};
+	static constexpr size_t HEADER = (sizeof(Node) + alignof(TYPE) - 1) /
+		alignof(TYPE) * alignof(TYPE);
+	static constexpr size_t LEAF_CAP =
+		(NODE_SIZE - HEADER - sizeof(void *)) / sizeof(TYPE);
+	static constexpr size_t INNER_CAP =
+		(NODE_SIZE - HEADER - sizeof(void *)) / (sizeof(TYPE) + sizeof(void *));
+	static constexpr size_t LEAF_MIN = LEAF_CAP / 2;
+	static constexpr size_t INNER_MIN = INNER_CAP / 2;
+	static_assert(std::is_trivially_copyable_v<TYPE>, "keys are moved by memcpy");
+
+	struct Leaf : Node {
+		Leaf *m_Next;
+		TYPE m_Keys[LEAF_CAP];
+	};
+	struct Inner : Node {
+		TYPE m_Keys[INNER_CAP];
+		Node *m_Children[INNER_CAP + 1];
+	};
+	static_assert(sizeof(Leaf) <= NODE_SIZE && sizeof(Inner) <= NODE_SIZE,
+		      "wrong capacity calculation");
+	/* A node starts a cache line, so it spans NODE_SIZE / 64 lines. */
+	static constexpr size_t NODE_ALIGN = 64;
+	static_assert(NODE_SIZE % NODE_ALIGN == 0, "nodes are whole lines");
+
+	BPlusTreeStruct() = default;
+	BPlusTreeStruct(const BPlusTreeStruct&) = delete;
+	BPlusTreeStruct& operator=(const BPlusTreeStruct&) = delete;
+	~BPlusTreeStruct()
+	{
+		clear();
+	}
+
+	bool insert(const TYPE& t)
+	{
+		if (m_Root == nullptr) {
+			Leaf *leaf = alloc<Leaf>();
+			leaf->m_Next = nullptr;
+			leaf->m_Count = 1;
+			leaf->m_Keys[0] = t;
+			m_Root = leaf;
+			m_Height = 0;
+			m_Size = 1;
+			return true;
+		}
+		Split split;
+		Status rc = insert(m_Root, m_Height, t, split);
+		if (rc == EXISTS)
+			return false;
+		if (rc == SPLITTED) {
+			Inner *root = alloc<Inner>();
+			root->m_Count = 1;
+			root->m_Keys[0] = split.key;
+			root->m_Children[0] = m_Root;
+			root->m_Children[1] = split.right;
+			m_Root = root;
+			m_Height++;
+		}
+		m_Size++;
+		return true;
+	}
+	bool remove(const TYPE& t)
+	{
+		if (m_Root == nullptr || !remove(m_Root, m_Height, t))
+			return false;
+		m_Size--;
+		if (m_Root->m_Count == 0) {
+			Node *old = m_Root;
+			m_Root = m_Height == 0 ? nullptr : ((Inner *)old)->m_Children[0];
+			if (m_Height > 0)
+				m_Height--;
+			free(old);
+		}
+		return true;
+	}
+	bool has(const TYPE& t) const
+	{
+		if (m_Root == nullptr)
+			return false;
+		const Node *node = m_Root;
+		for (size_t h = m_Height; h > 0; h--) {
+			const Inner *inner = (const Inner *)node;
+			size_t i = upper(inner->m_Keys, inner->m_Count, t);
+			node = inner->m_Children[i];
+		}
+		const Leaf *leaf = (const Leaf *)node;
+		size_t i = lower(leaf->m_Keys, leaf->m_Count, t);
+		return i < leaf->m_Count &&
+		       TypeTraits<TYPE>::equals(leaf->m_Keys[i], t);
+	}
+	/*
+	 * An empty tree is built from sorted keys bottom-up: full leaves are
+	 * filled left to right, then each level of inner nodes over the one
+	 * below. Keys are spread evenly so that the last node of a level is
+	 * not underflowed.
+	 */
+	void bulk_load(const TYPE *first, const TYPE *last, bool sorted)
+	{
+		if (!sorted || m_Root != nullptr) {
+			for (; first != last; ++first)
+				insert(*first);
+			return;
+		}
+		size_t n = 0;
+		for (const TYPE *p = first; p != last; ++p)
+			n += p == first || !TypeTraits<TYPE>::equals(p[-1], *p);
+		if (n == 0)
+			return;
+
+		size_t count = (n + LEAF_CAP - 1) / LEAF_CAP;
+		std::vector<Node *> level(count);
+		std::vector<TYPE> bounds(count);
+		Leaf *prev = nullptr;
+		for (size_t i = 0; i < count; i++) {
+			Leaf *leaf = alloc<Leaf>();
+			leaf->m_Count = n * (i + 1) / count - n * i / count;
+			for (size_t j = 0; j < leaf->m_Count; j++) {
+				leaf->m_Keys[j] = *first;
+				do
+					++first;
+				while (first != last &&
+				       TypeTraits<TYPE>::equals(*first, leaf->m_Keys[j]));
+			}
+			if (prev != nullptr)
+				prev->m_Next = leaf;
+			prev = leaf;
+			level[i] = leaf;
+			bounds[i] = leaf->m_Keys[0];
+		}
+		prev->m_Next = nullptr;
+
+		size_t height = 0;
+		for (; count > 1; height++) {
+			size_t parents = (count + INNER_CAP) / (INNER_CAP + 1);
+			for (size_t i = 0; i < parents; i++) {
+				size_t from = count * i / parents;
+				size_t to = count * (i + 1) / parents;
+				Inner *inner = alloc<Inner>();
+				inner->m_Count = to - from - 1;
+				for (size_t j = from; j < to; j++) {
+					inner->m_Children[j - from] = level[j];
+					if (j > from)
+						inner->m_Keys[j - from - 1] = bounds[j];
+				}
+				level[i] = inner;
+				bounds[i] = bounds[from];
+			}
+			count = parents;
+		}
+		m_Root = level[0];
+		m_Height = height;
+		m_Size = n;
+	}
+	bool lower_bound(const TYPE& t, TYPE& res) const
+	{
+		size_t i;
+		const Leaf *leaf = seek(t, i);
+		if (leaf == nullptr)
+			return false;
+		res = leaf->m_Keys[i];
+		return true;
+	}
+	/* Leaves are walked by the list, inner nodes are not visited again. */
+	template <class F>
+	size_t scan(const TYPE& from, size_t k, F&& f) const
+	{
+		size_t i;
+		const Leaf *leaf = seek(from, i);
+		size_t n = 0;
+		while (leaf != nullptr && n < k) {
+			size_t last = std::min<size_t>(leaf->m_Count, i + k - n);
+			for (; i < last; i++, n++)
+				f(leaf->m_Keys[i]);
+			leaf = leaf->m_Next;
+			i = 0;
+		}
+		return n;
+	}
+	void clear()
+	{
+		if (m_Root != nullptr)
+			destroy(m_Root, m_Height);
+		m_Root = nullptr;
+		m_Height = 0;
+		m_Size = 0;
+	}
+	size_t size() const
+	{
+		return m_Size;
+	}
+	static constexpr const char *family = "tree";
+	static constexpr const char *name = bplus::name(NODE_SIZE);
+	/* Wide keys do not fit in small nodes. */
+	static constexpr bool use = LEAF_CAP >= 3 && INNER_CAP >= 3;
+
+private:
+	enum Status {
+		EXISTS,
+		INSERTED,
+		SPLITTED,
+	};
+	struct Split {
+		TYPE key;
+		Node *right;
+	};
+
+	template <class NODE>
+	static NODE *alloc()
+	{
+		void *mem = aligned_alloc(NODE_ALIGN, NODE_SIZE);
+		if (mem == nullptr)
+			throw std::bad_alloc();
+		return (NODE *)mem;
+	}
+
+	/*
+	 * Leaf and position of the least key not less than t, the leaf is
+	 * null if there is no such key.
+	 */
+	const Leaf *seek(const TYPE& t, size_t& i) const
+	{
+		if (m_Root == nullptr)
+			return nullptr;
+		const Node *node = m_Root;
+		for (size_t h = m_Height; h > 0; h--) {
+			const Inner *inner = (const Inner *)node;
+			node = inner->m_Children[upper(inner->m_Keys, inner->m_Count, t)];
+		}
+		const Leaf *leaf = (const Leaf *)node;
+		i = lower(leaf->m_Keys, leaf->m_Count, t);
+		if (i < leaf->m_Count)
+			return leaf;
+		/* All keys of the next leaf are greater, its first one is not less. */
+		i = 0;
+		return leaf->m_Next;
+	}
+
+	template <size_t CAP>
+	static size_t lower(const TYPE (&keys)[CAP], size_t n, const TYPE& t)
+	{
+		return bplus::Search<TYPE>::template count<true, CAP>(keys, n, t);
+	}
+	template <size_t CAP>
+	static size_t upper(const TYPE (&keys)[CAP], size_t n, const TYPE& t)
+	{
+		return bplus::Search<TYPE>::template count<false, CAP>(keys, n, t);
+	}
+
+	template <class T>
+	static void shift(T *arr, size_t pos, size_t n)
+	{
+		memmove(arr + pos + 1, arr + pos, (n - pos) * sizeof(T));
+	}
+	template <class T>
+	static void unshift(T *arr, size_t pos, size_t n)
+	{
+		memmove(arr + pos, arr + pos + 1, (n - pos - 1) * sizeof(T));
+	}
+
+	Status insert(Node *node, size_t height, const TYPE& t, Split& split)
+	{
+		if (height == 0)
+			return insertLeaf((Leaf *)node, t, split);
+
+		Inner *inner = (Inner *)node;
+		size_t i = upper(inner->m_Keys, inner->m_Count, t);
+		Status rc = insert(inner->m_Children[i], height - 1, t, split);
+		if (rc != SPLITTED)
+			return rc;
+
+		size_t n = inner->m_Count;
+		if (n < INNER_CAP) {
+			shift(inner->m_Keys, i, n);
+			shift(inner->m_Children, i + 1, n + 1);
+			inner->m_Keys[i] = split.key;
+			inner->m_Children[i + 1] = split.right;
+			inner->m_Count++;
+			return INSERTED;
+		}
+
+		TYPE keys[INNER_CAP + 1];
+		Node *children[INNER_CAP + 2];
+		memcpy(keys, inner->m_Keys, i * sizeof(TYPE));
+		keys[i] = split.key;
+		memcpy(keys + i + 1, inner->m_Keys + i, (n - i) * sizeof(TYPE));
+		memcpy(children, inner->m_Children, (i + 1) * sizeof(Node *));
+		children[i + 1] = split.right;
+		memcpy(children + i + 2, inner->m_Children + i + 1,
+		       (n - i) * sizeof(Node *));
+
+		size_t left = (INNER_CAP + 1) / 2;
+		size_t right = INNER_CAP - left;
+		Inner *sibling = alloc<Inner>();
+		memcpy(inner->m_Keys, keys, left * sizeof(TYPE));
+		memcpy(inner->m_Children, children, (left + 1) * sizeof(Node *));
+		inner->m_Count = left;
+		memcpy(sibling->m_Keys, keys + left + 1, right * sizeof(TYPE));
+		memcpy(sibling->m_Children, children + left + 1,
+		       (right + 1) * sizeof(Node *));
+		sibling->m_Count = right;
+		split.key = keys[left];
+		split.right = sibling;
+		return SPLITTED;
+	}
+
+	Status insertLeaf(Leaf *leaf, const TYPE& t, Split& split)
+	{
+		size_t n = leaf->m_Count;
+		size_t i = lower(leaf->m_Keys, n, t);
+		if (i < n && TypeTraits<TYPE>::equals(leaf->m_Keys[i], t))
+			return EXISTS;
+		if (n < LEAF_CAP) {
+			shift(leaf->m_Keys, i, n);
+			leaf->m_Keys[i] = t;
+			leaf->m_Count++;
+			return INSERTED;
+		}
+
+		Leaf *sibling = alloc<Leaf>();
+		size_t left = (LEAF_CAP + 1) / 2;
+		size_t right = LEAF_CAP + 1 - left;
+		if (i < left) {
+			memcpy(sibling->m_Keys, leaf->m_Keys + left - 1,
+			       right * sizeof(TYPE));
+			shift(leaf->m_Keys, i, left - 1);
+			leaf->m_Keys[i] = t;
+		} else {
+			size_t j = i - left;
+			memcpy(sibling->m_Keys, leaf->m_Keys + left, j * sizeof(TYPE));
+			sibling->m_Keys[j] = t;
+			memcpy(sibling->m_Keys + j + 1, leaf->m_Keys + i,
+			       (n - i) * sizeof(TYPE));
+		}
+		leaf->m_Count = left;
+		sibling->m_Count = right;
+		sibling->m_Next = leaf->m_Next;
+		leaf->m_Next = sibling;
+		split.key = sibling->m_Keys[0];
+		split.right = sibling;
+		return SPLITTED;
+	}
+
+	bool remove(Node *node, size_t height, const TYPE& t)
+	{
+		if (height == 0) {
+			Leaf *leaf = (Leaf *)node;
+			size_t n = leaf->m_Count;
+			size_t i = lower(leaf->m_Keys, n, t);
+			if (i == n || !TypeTraits<TYPE>::equals(leaf->m_Keys[i], t))
+				return false;
+			unshift(leaf->m_Keys, i, n);
+			leaf->m_Count--;
+			return true;
+		}
+
+		Inner *inner = (Inner *)node;
+		size_t i = upper(inner->m_Keys, inner->m_Count, t);
+		if (!remove(inner->m_Children[i], height - 1, t))
+			return false;
+		if (height == 1) {
+			if (inner->m_Children[i]->m_Count < LEAF_MIN)
+				rebalanceLeaf(inner, i);
+		} else {
+			if (inner->m_Children[i]->m_Count < INNER_MIN)
+				rebalanceInner(inner, i);
+		}
+		return true;
+	}
+
+	/* Borrow a key from a sibling of an underflowed leaf or merge with it. */
+	void rebalanceLeaf(Inner *parent, size_t i)
+	{
+		Leaf *leaf = (Leaf *)parent->m_Children[i];
+		Leaf *left = i > 0 ? (Leaf *)parent->m_Children[i - 1] : nullptr;
+		Leaf *right = i < parent->m_Count ?
+			(Leaf *)parent->m_Children[i + 1] : nullptr;
+
+		if (left != nullptr && left->m_Count > LEAF_MIN) {
+			shift(leaf->m_Keys, 0, leaf->m_Count);
+			leaf->m_Keys[0] = left->m_Keys[--left->m_Count];
+			leaf->m_Count++;
+			parent->m_Keys[i - 1] = leaf->m_Keys[0];
+			return;
+		}
+		if (right != nullptr && right->m_Count > LEAF_MIN) {
+			leaf->m_Keys[leaf->m_Count++] = right->m_Keys[0];
+			unshift(right->m_Keys, 0, right->m_Count);
+			right->m_Count--;
+			parent->m_Keys[i] = right->m_Keys[0];
+			return;
+		}
+		if (left == nullptr) {
+			left = leaf;
+			i++;
+		} else {
+			right = leaf;
+		}
+		memcpy(left->m_Keys + left->m_Count, right->m_Keys,
+		       right->m_Count * sizeof(TYPE));
+		left->m_Count += right->m_Count;
+		left->m_Next = right->m_Next;
+		free(right);
+		unshift(parent->m_Keys, i - 1, parent->m_Count);
+		unshift(parent->m_Children, i, parent->m_Count + 1);
+		parent->m_Count--;
+	}
+
+	/* Same for inner nodes, separators rotate through the parent. */
+	void rebalanceInner(Inner *parent, size_t i)
+	{
+		Inner *inner = (Inner *)parent->m_Children[i];
+		Inner *left = i > 0 ? (Inner *)parent->m_Children[i - 1] : nullptr;
+		Inner *right = i < parent->m_Count ?
+			(Inner *)parent->m_Children[i + 1] : nullptr;
+
+		if (left != nullptr && left->m_Count > INNER_MIN) {
+			shift(inner->m_Keys, 0, inner->m_Count);
+			shift(inner->m_Children, 0, inner->m_Count + 1);
+			inner->m_Keys[0] = parent->m_Keys[i - 1];
+			inner->m_Children[0] = left->m_Children[left->m_Count];
+			inner->m_Count++;
+			parent->m_Keys[i - 1] = left->m_Keys[--left->m_Count];
+			return;
+		}
+		if (right != nullptr && right->m_Count > INNER_MIN) {
+			inner->m_Keys[inner->m_Count] = parent->m_Keys[i];
+			inner->m_Children[inner->m_Count + 1] = right->m_Children[0];
+			inner->m_Count++;
+			parent->m_Keys[i] = right->m_Keys[0];
+			unshift(right->m_Keys, 0, right->m_Count);
+			unshift(right->m_Children, 0, right->m_Count + 1);
+			right->m_Count--;
+			return;
+		}
+		if (left == nullptr) {
+			left = inner;
+			i++;
+		} else {
+			right = inner;
+		}
+		size_t n = left->m_Count;
+		left->m_Keys[n] = parent->m_Keys[i - 1];
+		memcpy(left->m_Keys + n + 1, right->m_Keys,
+		       right->m_Count * sizeof(TYPE));
+		memcpy(left->m_Children + n + 1, right->m_Children,
+		       (right->m_Count + 1) * sizeof(Node *));
+		left->m_Count += right->m_Count + 1;
+		free(right);
+		unshift(parent->m_Keys, i - 1, parent->m_Count);
+		unshift(parent->m_Children, i, parent->m_Count + 1);
+		parent->m_Count--;
+	}
+
+	static void destroy(Node *node, size_t height)
+	{
+		if (height > 0) {
+			Inner *inner = (Inner *)node;
+			for (size_t i = 0; i <= inner->m_Count; i++)
+				destroy(inner->m_Children[i], height - 1);
+		}
+		free(node);
+	}
+
+	Node *m_Root = nullptr;
+	size_t m_Height = 0;
+	size_t m_Size = 0;
+};
@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2020, Aleksandr Lyapunov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <Types.hpp>
+
+/*
+ * Open addressing hash set in the spirit of Swiss tables: every slot has
+ * a control byte that is either EMPTY, DELETED or 7 bits of the hash of
+ * the key. Control bytes are probed a group at a time with SIMD compares,
+ * so a lookup touches one or two cache lines of control bytes and
+ * compares keys only on a 7-bit hash match.
+ */
+namespace swiss {
+
+enum : int8_t {
+	EMPTY = -128,
+	DELETED = -2,
+};
+
+struct BitMask {
+	uint64_t m_Mask;
+	unsigned m_Shift;
+
+	explicit operator bool() const { return m_Mask != 0; }
+	unsigned lowest() const { return __builtin_ctzll(m_Mask) >> m_Shift; }
+	void next() { m_Mask &= m_Mask - 1; }
+};
+
+#if defined(__AVX2__)
+
+struct Group {
+	static constexpr size_t WIDTH = 32;
+
+	explicit Group(const int8_t *ctrl)
+		: m_Ctrl(_mm256_loadu_si256((const __m256i *)ctrl)) {}
+
+	BitMask match(int8_t h2) const
+	{
+		__m256i cmp = _mm256_cmpeq_epi8(m_Ctrl, _mm256_set1_epi8(h2));
+		return BitMask{(uint32_t)_mm256_movemask_epi8(cmp), 0};
+	}
+	BitMask matchEmpty() const
+	{
+		return match(EMPTY);
+	}
+	BitMask matchEmptyOrDeleted() const
+	{
+		return BitMask{(uint32_t)_mm256_movemask_epi8(m_Ctrl), 0};
+	}
+
+	__m256i m_Ctrl;
+};
+
+#elif defined(__SSE2__)
+
+struct Group {
+	static constexpr size_t WIDTH = 16;
+
+	explicit Group(const int8_t *ctrl)
+		: m_Ctrl(_mm_loadu_si128((const __m128i *)ctrl)) {}
+
+	BitMask match(int8_t h2) const
+	{
+		__m128i cmp = _mm_cmpeq_epi8(m_Ctrl, _mm_set1_epi8(h2));
+		return BitMask{(uint16_t)_mm_movemask_epi8(cmp), 0};
+	}
+	BitMask matchEmpty() const
+	{
+		return match(EMPTY);
+	}
+	BitMask matchEmptyOrDeleted() const
+	{
+		return BitMask{(uint16_t)_mm_movemask_epi8(m_Ctrl), 0};
+	}
+
+	__m128i m_Ctrl;
+};
+
+#else
+
+struct Group {
+	static constexpr size_t WIDTH = 8;
+	static constexpr uint64_t LSBS = 0x0101010101010101ull;
+	static constexpr uint64_t MSBS = 0x8080808080808080ull;
+
+	explicit Group(const int8_t *ctrl)
+	{
+		memcpy(&m_Ctrl, ctrl, sizeof(m_Ctrl));
+	}
+
+	BitMask match(int8_t h2) const
+	{
+		/* May give false positives, they are filtered by key compare. */
+		uint64_t x = m_Ctrl ^ (LSBS * (uint8_t)h2);
+		return BitMask{(x - LSBS) & ~x & MSBS, 3};
+	}
+	BitMask matchEmpty() const
+	{
+		/* EMPTY is the only control byte with 0b10 in the high bits. */
+		return BitMask{m_Ctrl & ~(m_Ctrl << 1) & MSBS, 3};
+	}
+	BitMask matchEmptyOrDeleted() const
+	{
+		return BitMask{m_Ctrl & MSBS, 3};
+	}
+
+	uint64_t m_Ctrl;
+};
+
+#endif
+
+inline uint64_t mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+} // namespace swiss {
+
+template <typename TYPE>
+struct SwissSetStruct {
+	static_assert(std::is_trivially_copyable_v<TYPE>, "keys are moved by memcpy");
+
+	using Group = swiss::Group;
+	static constexpr size_t WIDTH = Group::WIDTH;
+
+	SwissSetStruct() = default;
+	SwissSetStruct(const SwissSetStruct&) = delete;
+	SwissSetStruct& operator=(const SwissSetStruct&) = delete;
+	~SwissSetStruct()
+	{
+		free(m_Ctrl);
+	}
+
+	bool insert(const TYPE& t)
+	{
+		return insert(t, hash(t));
+	}
+	bool remove(const TYPE& t)
+	{
+		const TYPE *slot = find(t, hash(t));
+		if (slot == nullptr)
+			return false;
+		size_t pos = slot - m_Slots;
+		/*
+		 * Probing stops at a group with an empty slot, so if the group
+		 * already has one no probe sequence goes through this group and
+		 * the slot can be freed completely instead of a tombstone.
+		 */
+		Group g(m_Ctrl + pos / WIDTH * WIDTH);
+		if (g.matchEmpty()) {
+			m_Ctrl[pos] = swiss::EMPTY;
+			m_GrowthLeft++;
+		} else {
+			m_Ctrl[pos] = swiss::DELETED;
+		}
+		m_Size--;
+		return true;
+	}
+	bool has(const TYPE& t) const
+	{
+		return find(t, hash(t)) != nullptr;
+	}
+	/*
+	 * Batches are processed in stages over a window of keys: hash every
+	 * key and prefetch its control group, then match the groups and
+	 * prefetch slots of the candidates, then compare keys. Cache misses
+	 * of the window overlap instead of being taken one after another.
+	 */
+	void has_batch(const TYPE *keys, size_t count, bool *res) const
+	{
+		uint64_t h[BATCH];
+		for (size_t base = 0; base < count; base += BATCH) {
+			size_t n = std::min(BATCH, count - base);
+			for (size_t i = 0; i < n; i++) {
+				h[i] = hash(keys[base + i]);
+				prefetchGroup(h[i]);
+			}
+			for (size_t i = 0; i < n; i++)
+				prefetchSlot(h[i]);
+			for (size_t i = 0; i < n; i++)
+				res[base + i] = find(keys[base + i], h[i]) != nullptr;
+		}
+	}
+	void insert_batch(const TYPE *keys, size_t count, bool *res)
+	{
+		uint64_t h[BATCH];
+		for (size_t base = 0; base < count; base += BATCH) {
+			size_t n = std::min(BATCH, count - base);
+			for (size_t i = 0; i < n; i++) {
+				h[i] = hash(keys[base + i]);
+				prefetchGroup(h[i]);
+			}
+			for (size_t i = 0; i < n; i++)
+				res[base + i] = insert(keys[base + i], h[i]);
+		}
+	}
+	/* The table grows once for all the keys, they are inserted as a batch. */
+	void bulk_load(const TYPE *first, const TYPE *last, bool)
+	{
+		if (first == last)
+			return;
+		size_t need = m_Size + (last - first);
+		size_t capacity = m_Capacity == 0 ? WIDTH : m_Capacity;
+		while (maxLoad(capacity) < need)
+			capacity *= 2;
+		if (capacity != m_Capacity)
+			resize(capacity);
+		size_t count = last - first;
+		uint64_t h[BATCH];
+		for (size_t base = 0; base < count; base += BATCH) {
+			size_t n = std::min(BATCH, count - base);
+			for (size_t i = 0; i < n; i++) {
+				h[i] = hash(first[base + i]);
+				prefetchGroup(h[i]);
+			}
+			for (size_t i = 0; i < n; i++)
+				insert(first[base + i], h[i]);
+		}
+	}
+	void clear()
+	{
+		free(m_Ctrl);
+		m_Ctrl = nullptr;
+		m_Slots = nullptr;
+		m_Capacity = 0;
+		m_Size = 0;
+		m_GrowthLeft = 0;
+	}
+	size_t size() const
+	{
+		return m_Size;
+	}
+	/* Group index and H2 are taken from the hash, its bits are mixed. */
+	static uint64_t hash(const TYPE& t)
+	{
+		return swiss::mix(TypeTraits<TYPE>::hash(t));
+	}
+	static constexpr const char *family = "hash";
+	static constexpr const char *name = "swiss table";
+	static constexpr bool use = true;
+
+private:
+	/* Window of batched operations. */
+	static constexpr size_t BATCH = 16;
+
+	static int8_t h2(uint64_t h)
+	{
+		return h & 0x7f;
+	}
+	static size_t maxLoad(size_t capacity)
+	{
+		return capacity - capacity / 8;
+	}
+	size_t groupMask() const
+	{
+		return m_Capacity / WIDTH - 1;
+	}
+
+	bool insert(const TYPE& t, uint64_t h)
+	{
+		if (find(t, h) != nullptr)
+			return false;
+		size_t pos = findFree(h);
+		if (m_GrowthLeft == 0 &&
+		    (m_Capacity == 0 || m_Ctrl[pos] == swiss::EMPTY)) {
+			rehash();
+			pos = findFree(h);
+		}
+		if (m_Ctrl[pos] == swiss::EMPTY)
+			m_GrowthLeft--;
+		m_Ctrl[pos] = h2(h);
+		m_Slots[pos] = t;
+		m_Size++;
+		return true;
+	}
+
+	void prefetchGroup(uint64_t h) const
+	{
+		if (m_Capacity == 0)
+			return;
+		__builtin_prefetch(m_Ctrl + ((h >> 7) & groupMask()) * WIDTH);
+	}
+
+	/* Slot of the first candidate in the first group of the probe. */
+	void prefetchSlot(uint64_t h) const
+	{
+		if (m_Capacity == 0)
+			return;
+		size_t g = (h >> 7) & groupMask();
+		swiss::BitMask m = Group(m_Ctrl + g * WIDTH).match(h2(h));
+		if (m)
+			__builtin_prefetch(m_Slots + g * WIDTH + m.lowest());
+	}
+
+	const TYPE *find(const TYPE& t, uint64_t h) const
+	{
+		if (m_Capacity == 0)
+			return nullptr;
+		size_t mask = groupMask();
+		size_t g = (h >> 7) & mask;
+		for (size_t step = 1; ; step++) {
+			const int8_t *ctrl = m_Ctrl + g * WIDTH;
+			Group group(ctrl);
+			for (swiss::BitMask m = group.match(h2(h)); m; m.next()) {
+				const TYPE *slot = m_Slots + g * WIDTH + m.lowest();
+				if (TypeTraits<TYPE>::equals(*slot, t))
+					return slot;
+			}
+			if (group.matchEmpty())
+				return nullptr;
+			g = (g + step) & mask;
+		}
+	}
+
+	/* Position of the first empty or deleted slot in the probe sequence. */
+	size_t findFree(uint64_t h) const
+	{
+		if (m_Capacity == 0)
+			return 0;
+		size_t mask = groupMask();
+		size_t g = (h >> 7) & mask;
+		for (size_t step = 1; ; step++) {
+			Group group(m_Ctrl + g * WIDTH);
+			swiss::BitMask m = group.matchEmptyOrDeleted();
+			if (m)
+				return g * WIDTH + m.lowest();
+			g = (g + step) & mask;
+		}
+	}
+
+	void rehash()
+	{
+		if (m_Capacity > WIDTH && m_Size <= m_Capacity / 32 * 25)
+			dropDeletes();
+		else
+			resize(m_Capacity == 0 ? WIDTH : m_Capacity * 2);
+	}
+
+	void allocate(size_t capacity)
+	{
+		void *mem = malloc(capacity + capacity * sizeof(TYPE));
+		if (mem == nullptr)
+			throw std::bad_alloc();
+		m_Ctrl = (int8_t *)mem;
+		m_Slots = (TYPE *)(m_Ctrl + capacity);
+		memset(m_Ctrl, swiss::EMPTY, capacity);
+		m_Capacity = capacity;
+		m_GrowthLeft = maxLoad(capacity) - m_Size;
+	}
+
+	void resize(size_t capacity)
+	{
+		int8_t *old_ctrl = m_Ctrl;
+		TYPE *old_slots = m_Slots;
+		size_t old_capacity = m_Capacity;
+		allocate(capacity);
+		for (size_t i = 0; i < old_capacity; i++) {
+			if (old_ctrl[i] < 0)
+				continue;
+			uint64_t h = hash(old_slots[i]);
+			size_t pos = findFree(h);
+			m_Ctrl[pos] = h2(h);
+			m_Slots[pos] = old_slots[i];
+		}
+		free(old_ctrl);
+	}
+
+	/*
+	 * Rehash in place when the table is full mostly of tombstones: turn
+	 * tombstones into empty slots and every live slot into a tombstone,
+	 * then walk the tombstones moving each key to its first free slot.
+	 * A key whose target is another unprocessed key swaps with it and
+	 * the swapped key is processed at the same position again.
+	 */
+	void dropDeletes()
+	{
+		for (size_t i = 0; i < m_Capacity; i++)
+			m_Ctrl[i] = m_Ctrl[i] < 0 ? swiss::EMPTY : swiss::DELETED;
+		for (size_t i = 0; i < m_Capacity; i++) {
+			if (m_Ctrl[i] != swiss::DELETED)
+				continue;
+			uint64_t h = hash(m_Slots[i]);
+			size_t pos = findFree(h);
+			if (pos / WIDTH == i / WIDTH) {
+				m_Ctrl[i] = h2(h);
+				continue;
+			}
+			if (m_Ctrl[pos] == swiss::EMPTY) {
+				m_Ctrl[pos] = h2(h);
+				m_Slots[pos] = m_Slots[i];
+				m_Ctrl[i] = swiss::EMPTY;
+			} else {
+				m_Ctrl[pos] = h2(h);
+				std::swap(m_Slots[pos], m_Slots[i]);
+				i--;
+			}
+		}
+		m_GrowthLeft = maxLoad(m_Capacity) - m_Size;
+	}
+
+	int8_t *m_Ctrl = nullptr;
+	TYPE *m_Slots = nullptr;
+	size_t m_Capacity = 0;
+	size_t m_Size = 0;
+	size_t m_GrowthLeft = 0;
+};